@@ -29,6 +29,12 @@ https://github.com/skirridsystems/packbits
 #include <string.h>
 #include "packbits.h"
 
+// The CRC instruction is used when the processor has it
+#if defined(__x86_64__) && defined(__GNUC__)
+#define CRC_SSE42
+#include <nmmintrin.h>
+#endif
+
 #define MIN_REPT            3       // Minimum run to compress between differ blocks
 #define MAX_REPT            128     // Maximum run of repeated byte
 #define MAX_DIFF            128     // Maximum run of differing bytes
@@ -36,27 +42,96 @@ https://github.com/skirridsystems/packbits
 // Encoding for header byte based on number of bytes represented.
 #define ENCODE_DIFF(n)      (uint8_t)((n) - 1)
 #define ENCODE_REPT(n)      (uint8_t)(1 - (n))
+#define ENCODE_NOOP         128
 
 // Decoding for header byte to give output run length
 #define IS_DIFF(h)          ((h) < 128)
 #define IS_REPT(h)          ((h) > 128)
+#define IS_NOOP(h)          ((h) == 128)
 #define DECODE_DIFF(h)      (uint8_t)((h) + 1)
 #define DECODE_REPT(h)      (uint8_t)(1 - (h))
 
 /*----------------------------------------------------------------------------
-packbits compresses the source buffer to the destination buffer.
-Compression is not guaranteed if there are not enough runs.
-In the pathological case where there are no runs (e.g. an incrementing
-byte counter) then there is an overhead of 1 byte for each 128 bytes
-of source. If the destination buffer is not large enough to handle this,
-the function returns 0 and the destination buffer content is incomplete.
+Statistics.
 
-If unconditional compression is required, the size of the destination
-buffer must be at least srcCount + (srcCount + 127) / 128.
+If PACKBITS_STATS is defined, packbits and unpackbits count what they do in
+the structure attached with packbits_stats_attach. Otherwise the counting
+compiles to nothing and the packing and unpacking loops are unchanged.
 
-Return value is the size of destination buffer actually used.
+Collecting statistics is not thread safe. There is one attached structure for
+the whole program and every call updates it without locking, so statistics
+must only be collected while packing and unpacking are done from one thread,
+not while ranges or chunks are being processed in parallel.
 ----------------------------------------------------------------------------*/
-uint16_t packbits(const uint8_t *srcPtr, uint8_t *destPtr, uint16_t srcCount, uint16_t destLimit)
+
+// Histogram bin for a run length of 1..128: 1, 2, 3-4, 5-8, ... 65-128
+static uint8_t hist_bin(uint8_t count)
+{
+    uint8_t bin = 0;
+    
+    for (--count; count != 0; count >>= 1)
+    {
+        ++bin;
+    }
+    return bin;
+}
+
+#ifdef PACKBITS_STATS
+
+static packbits_stats_t *stats;     // Statistics being collected, or NULL
+
+#define STATS(s)            do { if (stats != NULL) { stats->s; } } while (0)
+
+void packbits_stats_attach(packbits_stats_t *statsPtr)
+{
+    stats = statsPtr;
+    if (stats != NULL)
+    {
+        memset(stats, 0, sizeof(*stats));
+    }
+}
+
+#else
+
+#define STATS(s)            do { } while (0)
+
+#endif
+
+// Count a header and the length of its run
+#define STATS_REPT(n)       do { STATS(reptHeaders++); STATS(reptBytes += (n)); STATS(reptHist[hist_bin(n)]++); } while (0)
+#define STATS_DIFF(n)       do { STATS(diffHeaders++); STATS(diffBytes += (n)); STATS(diffHist[hist_bin(n)]++); } while (0)
+
+// Copy literal bytes to the output. When packing in place the output can
+// overlap the pending bytes being copied.
+static inline void copy_diff(uint8_t *destPtr, const uint8_t *srcPtr, uint16_t count, bool inPlace)
+{
+    if (inPlace)
+    {
+        memmove(destPtr, srcPtr, count);
+    }
+    else
+    {
+        memcpy(destPtr, srcPtr, count);
+    }
+}
+
+// Count a packing failure due to lack of destination space.
+static inline uint16_t pack_overflow(void)
+{
+    STATS(packOverflow++);
+    return 0;
+}
+
+// Packing loop shared by packbits, packbits_opt and packbits_inplace.
+// A run is split out of the middle of a literal block if it is at least
+// minRun bytes long, or at the start of a block if at least startRun long.
+// If pendingCount is not NULL the last block is held back rather than
+// output, and its length in bytes at the end of the source is returned in
+// pendingCount, which is left alone on overflow. Packing restarts afresh
+// after every block output, so packing the held back bytes in front of
+// more data gives the same stream as packing everything in one call.
+static inline uint16_t pack_core(const uint8_t *srcPtr, uint8_t *destPtr, uint16_t srcCount, uint16_t destLimit,
+                                 uint16_t minRun, uint16_t startRun, bool inPlace, uint16_t *pendingCount)
 {
     bool inRun = false;
     uint16_t destCount = 0;             // Destination buffer used
@@ -84,7 +159,9 @@ uint16_t packbits(const uint8_t *srcPtr, uint8_t *destPtr, uint16_t srcCount, ui
             if ((currByte != lastByte) || (bytesPending > MAX_REPT))
             {
                 // End of run or maximum run length reached.
-                if (destCount + 2 > destLimit) return 0;
+                if (destCount + 2 > destLimit) return pack_overflow();
+                if (currByte == lastByte) STATS(maxReptSplits++);
+                STATS_REPT(bytesPending - 1);
                 destCount += 2;
                 *destPtr++ = ENCODE_REPT(bytesPending - 1);
                 *destPtr++ = lastByte;
@@ -100,10 +177,12 @@ uint16_t packbits(const uint8_t *srcPtr, uint8_t *destPtr, uint16_t srcCount, ui
             {
                 // We have as much differing data as we can output in one chunk.
                 // Output MAX_DIFF leaving one byte.
-                if (destCount + 1 + MAX_DIFF > destLimit) return 0;
+                if (destCount + 1 + MAX_DIFF > destLimit) return pack_overflow();
+                STATS(maxDiffSplits++);
+                STATS_DIFF(MAX_DIFF);
                 destCount += 1 + MAX_DIFF;
                 *destPtr++ = ENCODE_DIFF(MAX_DIFF);
-                memcpy(destPtr, pendingPtr, MAX_DIFF);
+                copy_diff(destPtr, pendingPtr, MAX_DIFF, inPlace);
                 destPtr += MAX_DIFF;
                 pendingPtr += MAX_DIFF;
                 bytesPending -= MAX_DIFF;
@@ -111,16 +190,17 @@ uint16_t packbits(const uint8_t *srcPtr, uint8_t *destPtr, uint16_t srcCount, ui
             }
             else if (currByte == lastByte)
             {
-                if ((bytesPending - runStart >= MIN_REPT) || (runStart == 0))
+                if ((bytesPending - runStart >= minRun) || ((runStart == 0) && (bytesPending >= startRun)))
                 {
                     // This is a worthwhile run
                     if (runStart != 0)
                     {
                         // Flush differing data out of input buffer
-                        if (destCount + 1 + runStart > destLimit) return 0;
+                        if (destCount + 1 + runStart > destLimit) return pack_overflow();
+                        STATS_DIFF(runStart);
                         destCount += 1 + runStart;
                         *destPtr++ = ENCODE_DIFF(runStart);
-                        memcpy(destPtr, pendingPtr, runStart);
+                        copy_diff(destPtr, pendingPtr, runStart, inPlace);
                         destPtr += runStart;
                     }
                     bytesPending -= runStart;  // Length of run
@@ -135,20 +215,121 @@ uint16_t packbits(const uint8_t *srcPtr, uint8_t *destPtr, uint16_t srcCount, ui
         lastByte = currByte;
     }
     
+    // Hold back the remainder for the caller to carry on from
+    if (pendingCount != NULL)
+    {
+        *pendingCount = bytesPending;
+        return destCount;
+    }
+    
     // Output the remainder
     if (inRun)
     {
-        if (destCount + 2 > destLimit) return 0;
+        if (destCount + 2 > destLimit) return pack_overflow();
+        STATS_REPT(bytesPending);
         destCount += 2;
         *destPtr++ = ENCODE_REPT(bytesPending);
         *destPtr++ = lastByte;
     }
     else
     {
-        if (destCount + 1 + bytesPending > destLimit) return 0;
+        if (destCount + 1 + bytesPending > destLimit) return pack_overflow();
+        STATS_DIFF(bytesPending);
         destCount += 1 + bytesPending;
         *destPtr++ = ENCODE_DIFF(bytesPending);
-        memcpy(destPtr, pendingPtr, bytesPending);
+        copy_diff(destPtr, pendingPtr, bytesPending, inPlace);
+    }
+    return destCount;
+}
+
+/*----------------------------------------------------------------------------
+packbits compresses the source buffer to the destination buffer.
+Compression is not guaranteed if there are not enough runs.
+In the pathological case where there are no runs (e.g. an incrementing
+byte counter) then there is an overhead of 1 byte for each 128 bytes
+of source. If the destination buffer is not large enough to handle this,
+the function returns 0 and the destination buffer content is incomplete.
+
+If unconditional compression is required, the size of the destination
+buffer must be at least srcCount + (srcCount + 127) / 128.
+
+Return value is the size of destination buffer actually used.
+----------------------------------------------------------------------------*/
+uint16_t packbits(const uint8_t *srcPtr, uint8_t *destPtr, uint16_t srcCount, uint16_t destLimit)
+{
+    return pack_core(srcPtr, destPtr, srcCount, destLimit, MIN_REPT, 2, false, NULL);
+}
+
+/*----------------------------------------------------------------------------
+packbits_opt compresses like packbits but with tuning options, or the same
+as packbits if options is NULL.
+
+minRun is the shortest run which is split out of a literal block. Values
+below MIN_REPT can only make the output larger and are treated as MIN_REPT.
+
+headerCost biases packing towards fewer, longer blocks, which unpack faster,
+at the expense of compression. Each header is charged as this many extra
+bytes: a run in the middle of a literal block adds two headers so it must be
+2 * headerCost bytes longer to be split out, and a run at the start of a
+block adds one header so it must be headerCost bytes longer.
+
+Neither option can increase the worst case size, so with rowLength of 0 the
+destination size needed for unconditional compression is the same as for
+packbits.
+
+If rowLength is not 0 the source is packed as separate rows of this many
+bytes, so no block spans two rows. If align is greater than 1, no operation
+headers are inserted before each row so that its packed data starts at a
+multiple of align bytes from destPtr. This allows rows to be located, loaded
+with aligned accesses or transferred by DMA. Each row is packed on its own,
+so its worst case is rowLength + (rowLength + 127) / 128 bytes, plus
+align - 1 bytes of padding if align is greater than 1. The destination size
+needed is the sum of this over all rows, the last of which may be short.
+
+Return value is the size of destination buffer actually used.
+----------------------------------------------------------------------------*/
+uint16_t packbits_opt(const uint8_t *srcPtr, uint8_t *destPtr, uint16_t srcCount, uint16_t destLimit,
+                      const packbits_options_t *options)
+{
+    uint16_t minRun = MIN_REPT;
+    uint16_t startRun = 2;
+    uint16_t rowLength = srcCount;      // Source bytes packed at a time
+    uint8_t align = 1;                  // Alignment of the start of each row
+    uint16_t destCount = 0;             // Destination buffer used
+    uint16_t count;                     // Size of the current row
+    uint16_t padCount;                  // No operation headers before the row
+    uint16_t packCount;                 // Packed size of the current row
+    
+    if (options != NULL)
+    {
+        if (options->minRun > minRun)
+        {
+            minRun = options->minRun;
+        }
+        minRun += 2 * options->headerCost;
+        startRun += options->headerCost;
+        if (options->rowLength != 0)
+        {
+            rowLength = options->rowLength;
+        }
+        if (options->align > 1)
+        {
+            align = options->align;
+        }
+    }
+    if (srcCount == 0) return 0;
+    while (srcCount != 0)
+    {
+        count = srcCount < rowLength ? srcCount : rowLength;
+        padCount = (align - destCount % align) % align;
+        if (destCount + padCount > destLimit) return pack_overflow();
+        memset(destPtr + destCount, ENCODE_NOOP, padCount);
+        destCount += padCount;
+        packCount = pack_core(srcPtr, destPtr + destCount, count, destLimit - destCount, minRun, startRun, false, NULL);
+        if (packCount == 0) return 0;
+        destCount += packCount;
+        srcPtr += count;
+        srcCount -= count;
     }
     return destCount;
 }
@@ -193,14 +374,17 @@ uint16_t unpackbits(const uint8_t *srcPtr, uint8_t *destPtr, uint16_t srcCount,
             if (count > destRemaining)
             {
                 count = destRemaining;
+                STATS(unpackTruncated++);
             }
             if (count > srcRemaining)
             {
                 count = srcRemaining;
+                STATS(unpackTruncated++);
             }
             if (count != 0)
             {
                 // Copy the differing byte run
+                STATS_DIFF(count);
                 memcpy(destPtr, srcPtr, count);
                 srcPtr += count;
                 srcRemaining -= count;
@@ -216,10 +400,12 @@ uint16_t unpackbits(const uint8_t *srcPtr, uint8_t *destPtr, uint16_t srcCount,
             if (count > destRemaining)
             {
                 count = destRemaining;
+                STATS(unpackTruncated++);
             }
             if ((count != 0) && (srcRemaining != 0))
             {
                 // Copy the repeated byte run
+                STATS_REPT(count);
                 memset(destPtr, *srcPtr, count);
                 srcPtr++;
                 srcRemaining--;
@@ -227,6 +413,25 @@ uint16_t unpackbits(const uint8_t *srcPtr, uint8_t *destPtr, uint16_t srcCount,
                 destRemaining -= count;
             }
         }
+        else
+        {
+            // No operation, skip all of any alignment padding
+            STATS(noopHeaders++);
+            while ((srcRemaining != 0) && IS_NOOP(*srcPtr))
+            {
+                STATS(noopHeaders++);
+                srcPtr++;
+                srcRemaining--;
+            }
+        }
+    }
+    if (destRemaining == 0)
+    {
+        STATS(unpackDestFull++);
+    }
+    else
+    {
+        STATS(unpackSrcEnd++);
     }
     if (srcCount == 0)
     {
@@ -345,3 +550,3123 @@ uint16_t unpackbits_window(const uint8_t *srcPtr, uint8_t *destPtr, uint16_t src
     }
     return destLimit - destRemaining;   // Number of bytes actually output
 }
+
+/*----------------------------------------------------------------------------
+unpackbits_init prepares an unpacker state for resumable unpacking.
+Unlike unpackbits, the state remembers a run which has only been partly
+output, so unpacking can stop and restart at any output position.
+
+As with unpackbits, a source size of 0 means the source is unlimited and
+unpacking is bounded only by the destination.
+----------------------------------------------------------------------------*/
+void unpackbits_init(packbits_state_t *state, const uint8_t *srcPtr, uint16_t srcCount)
+{
+    state->srcPtr = srcPtr;
+    state->srcRemaining = srcCount ? srcCount : 0xffff;
+    state->destPos = 0;
+    state->count = 0;
+    state->repeat = false;
+}
+
+// Read headers up to the start of the next run, returning false if the source
+// runs out first.
+static bool resume_run(packbits_state_t *state)
+{
+    uint8_t hdr;                    // Header byte indicating run length and type
+    
+    while (state->srcRemaining != 0)
+    {
+        hdr = *state->srcPtr++;
+        --state->srcRemaining;
+        if (IS_DIFF(hdr))
+        {
+            // Literal bytes are read as they are output
+            state->count = DECODE_DIFF(hdr);
+            if (state->count > state->srcRemaining)
+            {
+                state->count = (uint8_t)state->srcRemaining;
+            }
+            state->repeat = false;
+            return true;
+        }
+        else if (IS_REPT(hdr))
+        {
+            // The repeated byte is consumed now and found at srcPtr[-1]
+            if (state->srcRemaining == 0) break;
+            state->count = DECODE_REPT(hdr);
+            state->srcPtr++;
+            --state->srcRemaining;
+            state->repeat = true;
+            return true;
+        }
+    }
+    return false;
+}
+
+/*----------------------------------------------------------------------------
+unpackbits_resume continues unpacking from the given state, producing up to
+destLimit bytes. If destPtr is NULL the output bytes are skipped rather than
+stored, which is a cheap way to seek forward in the unpacked data.
+
+Return value is the number of bytes output or skipped. This is less than
+destLimit only if the source has run out.
+----------------------------------------------------------------------------*/
+uint16_t unpackbits_resume(packbits_state_t *state, uint8_t *destPtr, uint16_t destLimit)
+{
+    uint8_t count;                  // Bytes of the current run to output now
+    uint16_t destRemaining;         // Bytes still to be output
+    
+    destRemaining = destLimit;
+    while (destRemaining != 0)
+    {
+        if ((state->count == 0) && !resume_run(state)) break;
+        count = state->count;
+        if (count > destRemaining)
+        {
+            count = (uint8_t)destRemaining;
+        }
+        if (state->repeat)
+        {
+            if (destPtr) memset(destPtr, state->srcPtr[-1], count);
+        }
+        else
+        {
+            if (destPtr) memcpy(destPtr, state->srcPtr, count);
+            state->srcPtr += count;
+            state->srcRemaining -= count;
+        }
+        if (destPtr) destPtr += count;
+        state->count -= count;
+        state->destPos += count;
+        destRemaining -= count;
+    }
+    return destLimit - destRemaining;
+}
+
+/*----------------------------------------------------------------------------
+packbits_span_next reads the next run of a packed stream, set up with
+unpackbits_init, without unpacking it. The span gives the position and length
+of the run in the unpacked data and, for a literal run, points to its bytes
+in the packed data or, for a repeated run, to the repeated byte. If the state
+has been left part way through a run by unpackbits_resume, the rest of that
+run is returned first. Spans and unpackbits_resume can be mixed freely.
+
+Return value is false when the source has run out, in which case the span is
+not changed.
+----------------------------------------------------------------------------*/
+bool packbits_span_next(packbits_state_t *state, packbits_span_t *span)
+{
+    while (state->count == 0)
+    {
+        if (!resume_run(state)) return false;
+    }
+    span->offset = state->destPos;
+    span->length = state->count;
+    span->repeat = state->repeat;
+    if (state->repeat)
+    {
+        span->dataPtr = state->srcPtr - 1;
+    }
+    else
+    {
+        span->dataPtr = state->srcPtr;
+        state->srcPtr += state->count;
+        state->srcRemaining -= state->count;
+    }
+    state->destPos += state->count;
+    state->count = 0;
+    return true;
+}
+
+/*----------------------------------------------------------------------------
+packbits_cache_init sets up a cache of unpacked blocks for use with
+unpackbits_window_cached. All memory is supplied by the caller: an array of
+entries and a data area which is the byte budget for the cache. The data area
+is divided into blocks of blockSize bytes, one per entry, and any surplus
+entries or data are left unused.
+
+Return value is the number of blocks the cache can hold, which will be 0 if
+the data area is smaller than one block.
+----------------------------------------------------------------------------*/
+uint16_t packbits_cache_init(packbits_cache_t *cache, packbits_cache_entry_t *entries, uint16_t maxEntries,
+                             uint8_t *dataPtr, uint16_t dataSize, uint16_t blockSize)
+{
+    uint16_t i;
+    
+    cache->entries = entries;
+    cache->blockSize = blockSize;
+    cache->numEntries = blockSize ? dataSize / blockSize : 0;
+    if (cache->numEntries > maxEntries)
+    {
+        cache->numEntries = maxEntries;
+    }
+    for (i = 0; i < cache->numEntries; ++i)
+    {
+        entries[i].streamPtr = NULL;
+        entries[i].dataPtr = dataPtr;
+        dataPtr += blockSize;
+    }
+    return cache->numEntries;
+}
+
+/*----------------------------------------------------------------------------
+packbits_cache_invalidate discards all cached blocks for a packed stream,
+which must be done if the stream content changes. If streamPtr is NULL the
+whole cache is emptied.
+----------------------------------------------------------------------------*/
+void packbits_cache_invalidate(packbits_cache_t *cache, const uint8_t *streamPtr)
+{
+    uint16_t i;
+    
+    for (i = 0; i < cache->numEntries; ++i)
+    {
+        if ((streamPtr == NULL) || (cache->entries[i].streamPtr == streamPtr))
+        {
+            cache->entries[i].streamPtr = NULL;
+        }
+    }
+}
+
+// Find or unpack a block, returning it as the most recently used entry.
+static packbits_cache_entry_t *cache_fetch(packbits_cache_t *cache, const uint8_t *srcPtr, uint16_t srcCount, uint16_t block)
+{
+    packbits_cache_entry_t *entries = cache->entries;
+    packbits_cache_entry_t found;
+    packbits_state_t state;
+    uint16_t i;
+    uint16_t use = cache->numEntries - 1;   // Least recently used entry
+    uint16_t nearest = 0;                   // Closest cached block before the one wanted
+    bool haveNearest = false;
+    
+    for (i = 0; i < cache->numEntries; ++i)
+    {
+        if (entries[i].streamPtr != srcPtr) continue;
+        if (entries[i].block == block)
+        {
+            use = i;
+            break;
+        }
+        if ((entries[i].block < block) && (!haveNearest || (entries[i].block > entries[nearest].block)))
+        {
+            nearest = i;
+            haveNearest = true;
+        }
+    }
+    found = entries[use];
+    if ((found.streamPtr != srcPtr) || (found.block != block))
+    {
+        // Miss: resume from the end of the nearest earlier block if there is
+        // one, otherwise from the start of the stream.
+        if (haveNearest)
+        {
+            state = entries[nearest].next;
+        }
+        else
+        {
+            unpackbits_init(&state, srcPtr, srcCount);
+        }
+        unpackbits_resume(&state, NULL, block * cache->blockSize - state.destPos);
+        found.streamPtr = srcPtr;
+        found.block = block;
+        found.length = unpackbits_resume(&state, found.dataPtr, cache->blockSize);
+        found.next = state;
+    }
+    // Move to the front of the list
+    memmove(&entries[1], &entries[0], use * sizeof(entries[0]));
+    entries[0] = found;
+    return &entries[0];
+}
+
+/*----------------------------------------------------------------------------
+unpackbits_window_cached behaves like unpackbits_window but keeps recently
+unpacked blocks in a least recently used cache, keyed by the source pointer
+and block index. Overlapping windows of the same stream are then served by
+copying from the cache, and a missing block is unpacked starting from the
+end of the nearest cached block before it rather than from the start.
+
+If the cache has no blocks the window is unpacked directly with the
+resumable unpacker, giving the same result without caching anything.
+
+Always returns the number of bytes unpacked.
+----------------------------------------------------------------------------*/
+uint16_t unpackbits_window_cached(packbits_cache_t *cache, const uint8_t *srcPtr, uint8_t *destPtr,
+                                  uint16_t srcCount, uint16_t destStartByte, uint16_t destLimit)
+{
+    packbits_cache_entry_t *entry;
+    packbits_state_t state;                 // For unpacking without a cache
+    uint16_t destRemaining = destLimit;     // Buffer size still available for unpacking into
+    uint16_t destPos = destStartByte;       // Position in the unpacked data
+    uint16_t offset;                        // Position within the current block
+    uint16_t copyCount;                     // Bytes to copy from the current block
+    
+    if (cache->numEntries == 0)
+    {
+        unpackbits_init(&state, srcPtr, srcCount);
+        if (unpackbits_resume(&state, NULL, destStartByte) < destStartByte) return 0;
+        return unpackbits_resume(&state, destPtr, destLimit);
+    }
+    while (destRemaining != 0)
+    {
+        entry = cache_fetch(cache, srcPtr, srcCount, destPos / cache->blockSize);
+        offset = destPos % cache->blockSize;
+        if (entry->length <= offset) break;     // Beyond the end of the stream
+        copyCount = entry->length - offset;
+        if (copyCount > destRemaining)
+        {
+            copyCount = destRemaining;
+        }
+        memcpy(destPtr, entry->dataPtr + offset, copyCount);
+        destPtr += copyCount;
+        destPos += copyCount;
+        destRemaining -= copyCount;
+        if (entry->length < cache->blockSize) break;    // Last block of the stream
+    }
+    return destLimit - destRemaining;
+}
+
+/*----------------------------------------------------------------------------
+Scatter/gather buffers.
+
+A cursor walks through an array of segments as if they were one buffer.
+Runs and literal blocks may span segment boundaries. The total size of all
+segments is limited to 0xffff bytes, as for a single buffer.
+----------------------------------------------------------------------------*/
+typedef struct
+{
+    uint8_t *ptr;                   // Next byte in the current segment
+    uint16_t avail;                 // Bytes left in the current segment
+    const packbits_iovec_t *vec;    // Segments after the current one
+    uint16_t segs;                  // Number of segments after the current one
+    uint16_t space;                 // Bytes left in all segments
+    bool overflow;                  // A write did not fit
+} iov_cursor_t;
+
+static void cursor_init(iov_cursor_t *cursor, const packbits_iovec_t *vec, uint16_t segs)
+{
+    uint16_t i;
+    
+    cursor->ptr = NULL;
+    cursor->avail = 0;
+    cursor->vec = vec;
+    cursor->segs = segs;
+    cursor->space = 0;
+    cursor->overflow = false;
+    for (i = 0; i < segs; ++i)
+    {
+        cursor->space += vec[i].len;
+    }
+}
+
+// Return the bytes available in the current segment, moving on to the next
+// segment if the current one is used up. There must be space left.
+static uint16_t cursor_span(iov_cursor_t *cursor)
+{
+    while (cursor->avail == 0)
+    {
+        cursor->ptr = cursor->vec->ptr;
+        cursor->avail = cursor->vec->len;
+        ++cursor->vec;
+        --cursor->segs;
+    }
+    return cursor->avail;
+}
+
+static void cursor_advance(iov_cursor_t *cursor, uint16_t count)
+{
+    cursor->ptr += count;
+    cursor->avail -= count;
+    cursor->space -= count;
+}
+
+static uint8_t cursor_get(iov_cursor_t *cursor)
+{
+    uint8_t value;
+    
+    cursor_span(cursor);
+    value = *cursor->ptr;
+    cursor_advance(cursor, 1);
+    return value;
+}
+
+// Write a header and either count literal bytes or one repeated byte.
+// If the block does not fit nothing is written and overflow is set.
+static void cursor_emit(iov_cursor_t *cursor, uint8_t hdr, const uint8_t *dataPtr, uint16_t count)
+{
+    uint16_t n;
+    
+    if (cursor->space < 1 + count)
+    {
+        cursor->overflow = true;
+        return;
+    }
+    cursor_span(cursor);
+    *cursor->ptr = hdr;
+    cursor_advance(cursor, 1);
+    while (count != 0)
+    {
+        n = cursor_span(cursor);
+        if (n > count)
+        {
+            n = count;
+        }
+        memcpy(cursor->ptr, dataPtr, n);
+        cursor_advance(cursor, n);
+        dataPtr += n;
+        count -= n;
+    }
+}
+
+/*----------------------------------------------------------------------------
+Streaming packer.
+
+The encoder state holds the bytes of a literal block which have not yet been
+output, so source data can be supplied in pieces of any size. The output is
+identical to packing all the pieces in a single call to packbits.
+----------------------------------------------------------------------------*/
+
+#define MAX_EMIT            (1 + MAX_DIFF)  // Most output produced by one source byte
+
+// Pack a single byte, writing any completed block to the cursor.
+static void encode_byte(packbits_encoder_t *enc, uint8_t currByte, iov_cursor_t *dest)
+{
+    if (enc->bytesPending == 0)
+    {
+        // Prime compressor with first character.
+        enc->pending[0] = currByte;
+        enc->bytesPending = 1;
+        enc->lastByte = currByte;
+        return;
+    }
+    ++enc->bytesPending;
+    if (enc->inRun)
+    {
+        if ((currByte != enc->lastByte) || (enc->bytesPending > MAX_REPT))
+        {
+            // End of run or maximum run length reached.
+            cursor_emit(dest, ENCODE_REPT(enc->bytesPending - 1), &enc->lastByte, 1);
+            enc->pending[0] = currByte;
+            enc->bytesPending = 1;
+            enc->runStart = 0;
+            enc->inRun = false;
+        }
+    }
+    else
+    {
+        enc->pending[enc->bytesPending - 1] = currByte;
+        if (enc->bytesPending > MAX_DIFF)
+        {
+            // Output MAX_DIFF leaving one byte.
+            cursor_emit(dest, ENCODE_DIFF(MAX_DIFF), enc->pending, MAX_DIFF);
+            enc->pending[0] = currByte;
+            enc->bytesPending = 1;
+            enc->runStart = 0;          // A run could start here
+        }
+        else if (currByte == enc->lastByte)
+        {
+            if ((enc->bytesPending - enc->runStart >= MIN_REPT) || (enc->runStart == 0))
+            {
+                // This is a worthwhile run
+                if (enc->runStart != 0)
+                {
+                    // Flush differing data out of pending buffer
+                    cursor_emit(dest, ENCODE_DIFF(enc->runStart), enc->pending, enc->runStart);
+                }
+                enc->bytesPending -= enc->runStart;    // Length of run
+                enc->inRun = true;
+            }
+        }
+        else
+        {
+            enc->runStart = enc->bytesPending - 1;     // A run could start here
+        }
+    }
+    enc->lastByte = currByte;
+}
+
+// Output whatever is pending in the encoder.
+static void encode_flush(packbits_encoder_t *enc, iov_cursor_t *dest)
+{
+    if (enc->bytesPending == 0) return;
+    if (enc->inRun)
+    {
+        cursor_emit(dest, ENCODE_REPT(enc->bytesPending), &enc->lastByte, 1);
+    }
+    else
+    {
+        cursor_emit(dest, ENCODE_DIFF(enc->bytesPending), enc->pending, enc->bytesPending);
+    }
+}
+
+// Pack count copies of a byte. Once the encoder is in a run of that byte the
+// run is extended in bulk, so the output matches encode_byte on each copy.
+static void encode_run(packbits_encoder_t *enc, uint8_t value, uint16_t count, iov_cursor_t *dest)
+{
+    uint16_t n;
+    
+    while ((count != 0) && !dest->overflow)
+    {
+        if (enc->inRun && (enc->lastByte == value) && (enc->bytesPending < MAX_REPT))
+        {
+            n = MAX_REPT - enc->bytesPending;
+            if (n > count)
+            {
+                n = count;
+            }
+            enc->bytesPending += n;
+            count -= n;
+        }
+        else
+        {
+            encode_byte(enc, value, dest);
+            --count;
+        }
+    }
+}
+
+/*----------------------------------------------------------------------------
+packbits_encoder_init prepares an encoder state for streaming packing.
+----------------------------------------------------------------------------*/
+void packbits_encoder_init(packbits_encoder_t *enc)
+{
+    enc->bytesPending = 0;
+    enc->runStart = 0;
+    enc->lastByte = 0;
+    enc->inRun = false;
+}
+
+/*----------------------------------------------------------------------------
+packbits_encode packs the next piece of source data into the destination.
+Source bytes are consumed only while the destination has room for the largest
+possible output block (1 + 128 bytes), so packing stops early rather than
+failing when the destination fills. The number of source bytes consumed is
+returned in srcUsed and the caller should supply the rest in a later call.
+
+Return value is the size of destination buffer actually used.
+----------------------------------------------------------------------------*/
+uint16_t packbits_encode(packbits_encoder_t *enc, const uint8_t *srcPtr, uint16_t srcCount,
+                         uint8_t *destPtr, uint16_t destLimit, uint16_t *srcUsed)
+{
+    packbits_iovec_t destVec = { destPtr, destLimit };
+    iov_cursor_t dest;
+    uint16_t srcCountUsed = 0;          // Source bytes consumed
+    
+    cursor_init(&dest, &destVec, 1);
+    while ((srcCountUsed != srcCount) && (dest.space >= MAX_EMIT))
+    {
+        encode_byte(enc, srcPtr[srcCountUsed++], &dest);
+    }
+    *srcUsed = srcCountUsed;
+    return destLimit - dest.space;
+}
+
+/*----------------------------------------------------------------------------
+packbits_encode_end outputs any data still pending in the encoder and resets
+it ready for a new stream. A destination of 1 + 128 bytes is always enough.
+If the destination is too small the function returns 0 and the encoder is
+left unchanged so the call can be repeated.
+
+Return value is the size of destination buffer actually used.
+----------------------------------------------------------------------------*/
+uint16_t packbits_encode_end(packbits_encoder_t *enc, uint8_t *destPtr, uint16_t destLimit)
+{
+    packbits_iovec_t destVec = { destPtr, destLimit };
+    iov_cursor_t dest;
+    
+    cursor_init(&dest, &destVec, 1);
+    encode_flush(enc, &dest);
+    if (dest.overflow) return 0;
+    packbits_encoder_init(enc);
+    return destLimit - dest.space;
+}
+
+/*----------------------------------------------------------------------------
+packbits_encode_run packs count copies of value, as if they had been passed
+to packbits_encode, but a long run is added in one step rather than byte by
+byte. As for packbits_encode, packing stops early if the destination fills,
+and the number of copies consumed is returned in srcUsed.
+
+Return value is the size of destination buffer actually used.
+----------------------------------------------------------------------------*/
+uint16_t packbits_encode_run(packbits_encoder_t *enc, uint8_t value, uint16_t count,
+                             uint8_t *destPtr, uint16_t destLimit, uint16_t *srcUsed)
+{
+    packbits_iovec_t destVec = { destPtr, destLimit };
+    iov_cursor_t dest;
+    uint16_t remaining = count;         // Copies still to be packed
+    uint16_t n;
+    
+    cursor_init(&dest, &destVec, 1);
+    while ((remaining != 0) && (dest.space >= MAX_EMIT))
+    {
+        // Extend a run as far as it can go without output, then add one more
+        n = 1;
+        if (enc->inRun && (enc->lastByte == value) && (enc->bytesPending < MAX_REPT))
+        {
+            n = MAX_REPT - enc->bytesPending;
+            if (n > remaining)
+            {
+                n = remaining;
+            }
+        }
+        encode_run(enc, value, n, &dest);
+        remaining -= n;
+    }
+    *srcUsed = count - remaining;
+    return destLimit - dest.space;
+}
+
+/*----------------------------------------------------------------------------
+packbits_decoder_init prepares a decoder state for streaming unpacking.
+----------------------------------------------------------------------------*/
+void packbits_decoder_init(packbits_decoder_t *dec)
+{
+    dec->count = 0;
+    dec->value = 0;
+    dec->repeat = false;
+    dec->needValue = false;
+}
+
+/*----------------------------------------------------------------------------
+packbits_decode unpacks the next piece of a packed stream. Unlike
+unpackbits_resume, the packed data need not be in one buffer: a piece may
+end anywhere, even between a header and the bytes it describes, and the
+decoder carries on with the next piece. Unpacking stops when either the
+piece is used up or the destination is full. The number of source bytes
+consumed is returned in srcUsed and the caller should supply the rest, with
+more destination space, in a later call.
+
+Return value is the number of bytes output.
+----------------------------------------------------------------------------*/
+uint16_t packbits_decode(packbits_decoder_t *dec, const uint8_t *srcPtr, uint16_t srcCount,
+                         uint8_t *destPtr, uint16_t destLimit, uint16_t *srcUsed)
+{
+    uint8_t hdr;                    // Header byte indicating run length and type
+    uint16_t count;                 // Bytes of the current run to output now
+    uint16_t srcPos = 0;            // Source bytes consumed
+    uint16_t destRemaining;         // Buffer size still available for unpacking into
+    
+    destRemaining = destLimit;
+    while (destRemaining != 0)
+    {
+        if (dec->count == 0)
+        {
+            if (srcPos == srcCount) break;
+            hdr = srcPtr[srcPos++];
+            if (IS_DIFF(hdr))
+            {
+                dec->count = DECODE_DIFF(hdr);
+                dec->repeat = false;
+            }
+            else if (IS_REPT(hdr))
+            {
+                dec->count = DECODE_REPT(hdr);
+                dec->repeat = true;
+                dec->needValue = true;
+            }
+            continue;
+        }
+        if (dec->needValue)
+        {
+            if (srcPos == srcCount) break;
+            dec->value = srcPtr[srcPos++];
+            dec->needValue = false;
+        }
+        count = dec->count;
+        if (count > destRemaining)
+        {
+            count = destRemaining;
+        }
+        if (dec->repeat)
+        {
+            memset(destPtr, dec->value, count);
+        }
+        else
+        {
+            if (count > srcCount - srcPos)
+            {
+                count = srcCount - srcPos;
+            }
+            if (count == 0) break;
+            memcpy(destPtr, srcPtr + srcPos, count);
+            srcPos += count;
+        }
+        destPtr += count;
+        destRemaining -= count;
+        dec->count -= (uint8_t)count;
+    }
+    *srcUsed = srcPos;
+    return destLimit - destRemaining;
+}
+
+/*----------------------------------------------------------------------------
+packbits_decode_complete returns true if the data decoded so far ends on a
+block boundary, so a stream which stops here was not truncated.
+----------------------------------------------------------------------------*/
+bool packbits_decode_complete(const packbits_decoder_t *dec)
+{
+    return dec->count == 0;
+}
+
+/*----------------------------------------------------------------------------
+packbits_iov compresses source data held in an array of segments to a
+destination held in another array of segments, without first copying either
+into a contiguous buffer. The output is identical to packbits on the
+concatenated source. If the destination segments are not large enough the
+function returns 0 and the destination content is incomplete.
+
+Return value is the size of destination actually used.
+----------------------------------------------------------------------------*/
+uint16_t packbits_iov(const packbits_iovec_t *srcVec, uint16_t srcSegs, const packbits_iovec_t *destVec, uint16_t destSegs)
+{
+    packbits_encoder_t enc;
+    iov_cursor_t src;
+    iov_cursor_t dest;
+    uint16_t n;
+    uint16_t destLimit;
+    
+    packbits_encoder_init(&enc);
+    cursor_init(&src, srcVec, srcSegs);
+    cursor_init(&dest, destVec, destSegs);
+    destLimit = dest.space;
+    while ((src.space != 0) && !dest.overflow)
+    {
+        n = cursor_span(&src);
+        while ((n-- != 0) && !dest.overflow)
+        {
+            encode_byte(&enc, *src.ptr, &dest);
+            cursor_advance(&src, 1);
+        }
+    }
+    encode_flush(&enc, &dest);
+    if (dest.overflow) return 0;
+    return destLimit - dest.space;
+}
+
+/*----------------------------------------------------------------------------
+unpackbits_iov decompresses source data held in an array of segments to a
+destination held in another array of segments. Unpacking stops when either
+the source runs out or the destination is full, as for unpackbits.
+
+Return value is the unpacked size.
+----------------------------------------------------------------------------*/
+uint16_t unpackbits_iov(const packbits_iovec_t *srcVec, uint16_t srcSegs, const packbits_iovec_t *destVec, uint16_t destSegs)
+{
+    iov_cursor_t src;
+    iov_cursor_t dest;
+    uint8_t hdr;                    // Header byte indicating run length and type
+    uint8_t value;                  // Repeated byte
+    uint16_t count;                 // Run length derived from header
+    uint16_t n;                     // Bytes to copy within the current segments
+    uint16_t destLimit;
+    
+    cursor_init(&src, srcVec, srcSegs);
+    cursor_init(&dest, destVec, destSegs);
+    destLimit = dest.space;
+    while ((src.space != 0) && (dest.space != 0))
+    {
+        hdr = cursor_get(&src);
+        if (IS_DIFF(hdr))
+        {
+            // This is a run of differing bytes
+            count = DECODE_DIFF(hdr);
+            if (count > dest.space)
+            {
+                count = dest.space;
+            }
+            if (count > src.space)
+            {
+                count = src.space;
+            }
+            while (count != 0)
+            {
+                n = cursor_span(&src);
+                if (n > cursor_span(&dest))
+                {
+                    n = dest.avail;
+                }
+                if (n > count)
+                {
+                    n = count;
+                }
+                memcpy(dest.ptr, src.ptr, n);
+                cursor_advance(&src, n);
+                cursor_advance(&dest, n);
+                count -= n;
+            }
+        }
+        else if (IS_REPT(hdr) && (src.space != 0))
+        {
+            // This is a run of repeated bytes
+            count = DECODE_REPT(hdr);
+            if (count > dest.space)
+            {
+                count = dest.space;
+            }
+            value = cursor_get(&src);
+            while (count != 0)
+            {
+                n = cursor_span(&dest);
+                if (n > count)
+                {
+                    n = count;
+                }
+                memset(dest.ptr, value, n);
+                cursor_advance(&dest, n);
+                count -= n;
+            }
+        }
+    }
+    return destLimit - dest.space;
+}
+
+/*----------------------------------------------------------------------------
+Allocation-free context.
+
+A context bundles an encoder, an unpacker state and an index of unpacker
+states at regular output positions, all held in a single block of memory
+supplied by the caller. packbits_ctx_size gives the size of block needed for
+a given number of index entries. The block must be aligned for a pointer.
+----------------------------------------------------------------------------*/
+struct packbits_ctx
+{
+    packbits_encoder_t encoder;     // Streaming packer
+    packbits_state_t decoder;       // Unpacker, left positioned after each window
+    uint16_t indexSize;             // Number of index entries available
+    uint16_t indexCount;            // Number of index entries in use
+    uint16_t indexInterval;         // Unpacked bytes between index entries
+    packbits_state_t index[];       // Unpacker state at each multiple of indexInterval
+};
+
+size_t packbits_ctx_size(uint16_t indexEntries)
+{
+    return sizeof(packbits_ctx_t) + indexEntries * sizeof(packbits_state_t);
+}
+
+/*----------------------------------------------------------------------------
+packbits_ctx_init places a context in the caller's memory block.
+Return value is the context, or NULL if the block is too small.
+----------------------------------------------------------------------------*/
+packbits_ctx_t *packbits_ctx_init(void *memPtr, size_t memSize, uint16_t indexEntries)
+{
+    packbits_ctx_t *ctx = memPtr;
+    
+    if ((memPtr == NULL) || (memSize < packbits_ctx_size(indexEntries))) return NULL;
+    packbits_encoder_init(&ctx->encoder);
+    memset(&ctx->decoder, 0, sizeof(ctx->decoder));    // Nothing to unpack yet
+    ctx->indexSize = indexEntries;
+    ctx->indexCount = 0;
+    ctx->indexInterval = 0;
+    return ctx;
+}
+
+// Access to the encoder and unpacker held in a context.
+packbits_encoder_t *packbits_ctx_encoder(packbits_ctx_t *ctx)
+{
+    return &ctx->encoder;
+}
+
+packbits_state_t *packbits_ctx_decoder(packbits_ctx_t *ctx)
+{
+    return &ctx->decoder;
+}
+
+/*----------------------------------------------------------------------------
+packbits_ctx_index scans a packed stream and records the unpacker state every
+indexInterval bytes of output, so that windows can later be unpacked without
+starting from the beginning. If the stream is longer than the index can
+cover, windows beyond the last entry are unpacked from that entry.
+The unpacker state is positioned at the start of the stream.
+
+Return value is the number of index entries used.
+----------------------------------------------------------------------------*/
+uint16_t packbits_ctx_index(packbits_ctx_t *ctx, const uint8_t *srcPtr, uint16_t srcCount, uint16_t indexInterval)
+{
+    packbits_state_t state;
+    
+    unpackbits_init(&state, srcPtr, srcCount);
+    ctx->decoder = state;
+    ctx->indexInterval = indexInterval;
+    ctx->indexCount = 0;
+    if (indexInterval == 0) return 0;
+    while (ctx->indexCount < ctx->indexSize)
+    {
+        ctx->index[ctx->indexCount++] = state;
+        if (unpackbits_resume(&state, NULL, indexInterval) != indexInterval) break;
+    }
+    return ctx->indexCount;
+}
+
+/*----------------------------------------------------------------------------
+unpackbits_ctx_window unpacks a window of the stream indexed by
+packbits_ctx_index, starting from the nearest index entry. The context's
+unpacker is left positioned after the window, so unpacking can continue
+sequentially with unpackbits_resume.
+
+Always returns the number of bytes unpacked.
+----------------------------------------------------------------------------*/
+uint16_t unpackbits_ctx_window(packbits_ctx_t *ctx, uint8_t *destPtr, uint16_t destStartByte, uint16_t destLimit)
+{
+    uint16_t entry;
+    
+    if (ctx->indexCount == 0) return 0;
+    entry = destStartByte / ctx->indexInterval;
+    if (entry >= ctx->indexCount)
+    {
+        entry = ctx->indexCount - 1;
+    }
+    ctx->decoder = ctx->index[entry];
+    unpackbits_resume(&ctx->decoder, NULL, destStartByte - ctx->decoder.destPos);
+    if (ctx->decoder.destPos != destStartByte) return 0;
+    return unpackbits_resume(&ctx->decoder, destPtr, destLimit);
+}
+
+/*----------------------------------------------------------------------------
+unpackbits_inplace_margin finds how far the unpacked output of a stream gets
+ahead of the packed input, which is the extra space needed to unpack the
+stream in place with unpackbits_inplace. The buffer must be at least
+srcCount + margin bytes long.
+
+Return value is the margin in bytes.
+----------------------------------------------------------------------------*/
+uint16_t unpackbits_inplace_margin(const uint8_t *srcPtr, uint16_t srcCount)
+{
+    uint8_t hdr;                    // Header byte indicating run length and type
+    uint8_t count;                  // Run length derived from header
+    uint16_t srcPos = 0;            // Source bytes consumed
+    uint16_t destPos = 0;           // Bytes output
+    uint16_t margin = 0;            // Largest lead of output over input
+    
+    while (srcPos < srcCount)
+    {
+        hdr = srcPtr[srcPos++];
+        if (IS_DIFF(hdr))
+        {
+            count = DECODE_DIFF(hdr);
+            if (count > srcCount - srcPos)
+            {
+                count = (uint8_t)(srcCount - srcPos);
+            }
+            srcPos += count;
+        }
+        else if (IS_REPT(hdr) && (srcPos < srcCount))
+        {
+            count = DECODE_REPT(hdr);
+            srcPos++;
+        }
+        else
+        {
+            continue;
+        }
+        destPos += count;
+        if ((destPos > srcPos) && (destPos - srcPos > margin))
+        {
+            margin = destPos - srcPos;
+        }
+    }
+    return margin;
+}
+
+/*----------------------------------------------------------------------------
+unpackbits_inplace unpacks a stream within a single buffer. The packed data
+must be placed at the end of the buffer, bufPtr + bufSize - srcCount, and the
+unpacked data is written from the start of the buffer, overwriting the packed
+data once it has been read. The buffer must be at least srcCount plus the
+margin given by unpackbits_inplace_margin.
+
+If the output would overwrite source not yet read, the function returns 0 and
+the buffer content is incomplete.
+
+Return value is the unpacked size.
+----------------------------------------------------------------------------*/
+uint16_t unpackbits_inplace(uint8_t *bufPtr, uint16_t srcCount, uint16_t bufSize)
+{
+    uint8_t hdr;                    // Header byte indicating run length and type
+    uint8_t count;                  // Run length derived from header
+    uint16_t srcPos;                // Position of the next source byte in the buffer
+    uint16_t destPos = 0;           // Position of the next output byte in the buffer
+    
+    if (srcCount > bufSize) return 0;
+    srcPos = bufSize - srcCount;
+    while (srcPos < bufSize)
+    {
+        hdr = bufPtr[srcPos++];
+        if (IS_DIFF(hdr))
+        {
+            // This is a run of differing bytes
+            count = DECODE_DIFF(hdr);
+            if (count > bufSize - srcPos)
+            {
+                count = (uint8_t)(bufSize - srcPos);
+            }
+            // Output may overlap the bytes being copied but not those after
+            if (destPos > srcPos) return 0;
+            memmove(bufPtr + destPos, bufPtr + srcPos, count);
+            srcPos += count;
+            destPos += count;
+        }
+        else if (IS_REPT(hdr) && (srcPos < bufSize))
+        {
+            // This is a run of repeated bytes
+            count = DECODE_REPT(hdr);
+            srcPos++;
+            if (destPos + count > srcPos) return 0;
+            memset(bufPtr + destPos, bufPtr[srcPos - 1], count);
+            destPos += count;
+        }
+    }
+    return destPos;
+}
+
+/*----------------------------------------------------------------------------
+packbits_inplace compresses a buffer onto itself. The source data must be
+placed PACKBITS_INPLACE_MARGIN(srcCount) bytes from the start of the buffer
+and the packed data is written from the start of the buffer. The margin is
+the worst case packing overhead of 1 byte for each 128 bytes, so the output
+never overtakes the source bytes still to be read and the buffer need only
+be srcCount + PACKBITS_INPLACE_MARGIN(srcCount) bytes long.
+
+Return value is the packed size.
+----------------------------------------------------------------------------*/
+uint16_t packbits_inplace(uint8_t *bufPtr, uint16_t srcCount)
+{
+    uint16_t margin = PACKBITS_INPLACE_MARGIN(srcCount);
+    
+    return pack_core(bufPtr + margin, bufPtr, srcCount, srcCount + margin, MIN_REPT, 2, true, NULL);
+}
+
+/*----------------------------------------------------------------------------
+Stream analysis.
+
+The analysis gathers the run structure of packed streams, or of raw data as
+packbits would pack it, so that the likely compression and unpacking cost of
+a set of data can be judged. Results accumulate over any number of calls.
+----------------------------------------------------------------------------*/
+
+// Work out the summary figures from the counts.
+static void analysis_update(packbits_analysis_t *analysis)
+{
+    uint32_t headers = analysis->reptHeaders + analysis->diffHeaders + analysis->noopHeaders;
+    
+    if (analysis->unpackedBytes == 0) return;
+    
+    // Totals are kept across calls, so scale them in 64 bits
+    analysis->packedPercent = (uint16_t)(((uint64_t)analysis->packedBytes * 100 + analysis->unpackedBytes / 2) / analysis->unpackedBytes);
+    analysis->diffPercent = (uint16_t)(((uint64_t)analysis->diffBytes * 100 + analysis->unpackedBytes / 2) / analysis->unpackedBytes);
+    analysis->headersPerKB = (uint16_t)(((uint64_t)headers * 1024 + analysis->unpackedBytes / 2) / analysis->unpackedBytes);
+}
+
+// Count the headers of a packed stream without updating the summary.
+static void analyse_blocks(packbits_analysis_t *analysis, const uint8_t *srcPtr, uint16_t srcCount)
+{
+    uint8_t hdr;                    // Header byte indicating run length and type
+    uint8_t count;                  // Run length derived from header
+    
+    analysis->packedBytes += srcCount;
+    while (srcCount != 0)
+    {
+        hdr = *srcPtr++;
+        --srcCount;
+        if (IS_DIFF(hdr))
+        {
+            count = DECODE_DIFF(hdr);
+            if (count > srcCount)
+            {
+                count = (uint8_t)srcCount;
+            }
+            if (count == 0) continue;
+            srcPtr += count;
+            srcCount -= count;
+            ++analysis->diffHeaders;
+            analysis->diffBytes += count;
+            ++analysis->diffHist[hist_bin(count)];
+        }
+        else if (IS_REPT(hdr))
+        {
+            if (srcCount == 0) continue;
+            count = DECODE_REPT(hdr);
+            ++srcPtr;
+            --srcCount;
+            ++analysis->reptHeaders;
+            analysis->reptBytes += count;
+            ++analysis->reptHist[hist_bin(count)];
+        }
+        else
+        {
+            ++analysis->noopHeaders;
+            continue;
+        }
+        analysis->unpackedBytes += count;
+    }
+}
+
+/*----------------------------------------------------------------------------
+packbits_analysis_init clears an analysis ready to accumulate results.
+----------------------------------------------------------------------------*/
+void packbits_analysis_init(packbits_analysis_t *analysis)
+{
+    memset(analysis, 0, sizeof(*analysis));
+}
+
+/*----------------------------------------------------------------------------
+packbits_analyse adds an existing packed stream to the analysis.
+----------------------------------------------------------------------------*/
+void packbits_analyse(packbits_analysis_t *analysis, const uint8_t *srcPtr, uint16_t srcCount)
+{
+    analyse_blocks(analysis, srcPtr, srcCount);
+    analysis_update(analysis);
+}
+
+/*----------------------------------------------------------------------------
+packbits_analyse_raw adds raw data to the analysis as if it had been packed
+by packbits. The data is packed a few blocks at a time into a small buffer
+on the stack, so no output buffer is needed.
+----------------------------------------------------------------------------*/
+void packbits_analyse_raw(packbits_analysis_t *analysis, const uint8_t *srcPtr, uint16_t srcCount)
+{
+    packbits_encoder_t enc;
+    uint8_t blocks[2 * MAX_EMIT];   // Packed output waiting to be analysed
+    uint16_t srcUsed;
+    uint16_t count;
+    
+    packbits_encoder_init(&enc);
+    while (srcCount != 0)
+    {
+        count = packbits_encode(&enc, srcPtr, srcCount, blocks, sizeof(blocks), &srcUsed);
+        analyse_blocks(analysis, blocks, count);
+        srcPtr += srcUsed;
+        srcCount -= srcUsed;
+    }
+    count = packbits_encode_end(&enc, blocks, sizeof(blocks));
+    analyse_blocks(analysis, blocks, count);
+    analysis_update(analysis);
+}
+
+/*----------------------------------------------------------------------------
+Framed packing.
+
+The source is divided into blocks and each block is stored either packed or
+raw, whichever unpacks faster for the space saved. Each block starts with a
+frame header:
+
+Byte 0      Tag: bit 0 set = raw, clear = packed
+                 bit 1 set = unpacked length and checksum follow
+Byte 1..2   Length of the block data, least significant byte first
+Byte 3..4   Unpacked length of the block, if bit 1 of the tag is set
+Byte 5..8   CRC-32C of the unpacked block, if bit 1 of the tag is set
+
+Multi-byte values are stored least significant byte first. A raw block is
+unpacked by a single memcpy, so unpacking noisy data is never slower than
+copying it.
+----------------------------------------------------------------------------*/
+
+#define FRAME_PACKED        0x00    // Block is packbits data
+#define FRAME_RAW           0x01    // Block is stored unpacked
+#define FRAME_CHECKED       0x02    // Unpacked length and checksum follow
+#define FRAME_HDR_SIZE      3       // Tag and length
+#define FRAME_CHECK_SIZE    6       // Unpacked length and checksum
+
+// CRC-32C (Castagnoli) tables for slicing by 8, reflected. Table k gives the
+// remainder of a byte followed by k zero bytes.
+static const uint32_t crcTable[8][256] =
+{
+    {
+        0x00000000u, 0xf26b8303u, 0xe13b70f7u, 0x1350f3f4u, 0xc79a971fu, 0x35f1141cu, 0x26a1e7e8u, 0xd4ca64ebu,
+        0x8ad958cfu, 0x78b2dbccu, 0x6be22838u, 0x9989ab3bu, 0x4d43cfd0u, 0xbf284cd3u, 0xac78bf27u, 0x5e133c24u,
+        0x105ec76fu, 0xe235446cu, 0xf165b798u, 0x030e349bu, 0xd7c45070u, 0x25afd373u, 0x36ff2087u, 0xc494a384u,
+        0x9a879fa0u, 0x68ec1ca3u, 0x7bbcef57u, 0x89d76c54u, 0x5d1d08bfu, 0xaf768bbcu, 0xbc267848u, 0x4e4dfb4bu,
+        0x20bd8edeu, 0xd2d60dddu, 0xc186fe29u, 0x33ed7d2au, 0xe72719c1u, 0x154c9ac2u, 0x061c6936u, 0xf477ea35u,
+        0xaa64d611u, 0x580f5512u, 0x4b5fa6e6u, 0xb93425e5u, 0x6dfe410eu, 0x9f95c20du, 0x8cc531f9u, 0x7eaeb2fau,
+        0x30e349b1u, 0xc288cab2u, 0xd1d83946u, 0x23b3ba45u, 0xf779deaeu, 0x05125dadu, 0x1642ae59u, 0xe4292d5au,
+        0xba3a117eu, 0x4851927du, 0x5b016189u, 0xa96ae28au, 0x7da08661u, 0x8fcb0562u, 0x9c9bf696u, 0x6ef07595u,
+        0x417b1dbcu, 0xb3109ebfu, 0xa0406d4bu, 0x522bee48u, 0x86e18aa3u, 0x748a09a0u, 0x67dafa54u, 0x95b17957u,
+        0xcba24573u, 0x39c9c670u, 0x2a993584u, 0xd8f2b687u, 0x0c38d26cu, 0xfe53516fu, 0xed03a29bu, 0x1f682198u,
+        0x5125dad3u, 0xa34e59d0u, 0xb01eaa24u, 0x42752927u, 0x96bf4dccu, 0x64d4cecfu, 0x77843d3bu, 0x85efbe38u,
+        0xdbfc821cu, 0x2997011fu, 0x3ac7f2ebu, 0xc8ac71e8u, 0x1c661503u, 0xee0d9600u, 0xfd5d65f4u, 0x0f36e6f7u,
+        0x61c69362u, 0x93ad1061u, 0x80fde395u, 0x72966096u, 0xa65c047du, 0x5437877eu, 0x4767748au, 0xb50cf789u,
+        0xeb1fcbadu, 0x197448aeu, 0x0a24bb5au, 0xf84f3859u, 0x2c855cb2u, 0xdeeedfb1u, 0xcdbe2c45u, 0x3fd5af46u,
+        0x7198540du, 0x83f3d70eu, 0x90a324fau, 0x62c8a7f9u, 0xb602c312u, 0x44694011u, 0x5739b3e5u, 0xa55230e6u,
+        0xfb410cc2u, 0x092a8fc1u, 0x1a7a7c35u, 0xe811ff36u, 0x3cdb9bddu, 0xceb018deu, 0xdde0eb2au, 0x2f8b6829u,
+        0x82f63b78u, 0x709db87bu, 0x63cd4b8fu, 0x91a6c88cu, 0x456cac67u, 0xb7072f64u, 0xa457dc90u, 0x563c5f93u,
+        0x082f63b7u, 0xfa44e0b4u, 0xe9141340u, 0x1b7f9043u, 0xcfb5f4a8u, 0x3dde77abu, 0x2e8e845fu, 0xdce5075cu,
+        0x92a8fc17u, 0x60c37f14u, 0x73938ce0u, 0x81f80fe3u, 0x55326b08u, 0xa759e80bu, 0xb4091bffu, 0x466298fcu,
+        0x1871a4d8u, 0xea1a27dbu, 0xf94ad42fu, 0x0b21572cu, 0xdfeb33c7u, 0x2d80b0c4u, 0x3ed04330u, 0xccbbc033u,
+        0xa24bb5a6u, 0x502036a5u, 0x4370c551u, 0xb11b4652u, 0x65d122b9u, 0x97baa1bau, 0x84ea524eu, 0x7681d14du,
+        0x2892ed69u, 0xdaf96e6au, 0xc9a99d9eu, 0x3bc21e9du, 0xef087a76u, 0x1d63f975u, 0x0e330a81u, 0xfc588982u,
+        0xb21572c9u, 0x407ef1cau, 0x532e023eu, 0xa145813du, 0x758fe5d6u, 0x87e466d5u, 0x94b49521u, 0x66df1622u,
+        0x38cc2a06u, 0xcaa7a905u, 0xd9f75af1u, 0x2b9cd9f2u, 0xff56bd19u, 0x0d3d3e1au, 0x1e6dcdeeu, 0xec064eedu,
+        0xc38d26c4u, 0x31e6a5c7u, 0x22b65633u, 0xd0ddd530u, 0x0417b1dbu, 0xf67c32d8u, 0xe52cc12cu, 0x1747422fu,
+        0x49547e0bu, 0xbb3ffd08u, 0xa86f0efcu, 0x5a048dffu, 0x8ecee914u, 0x7ca56a17u, 0x6ff599e3u, 0x9d9e1ae0u,
+        0xd3d3e1abu, 0x21b862a8u, 0x32e8915cu, 0xc083125fu, 0x144976b4u, 0xe622f5b7u, 0xf5720643u, 0x07198540u,
+        0x590ab964u, 0xab613a67u, 0xb831c993u, 0x4a5a4a90u, 0x9e902e7bu, 0x6cfbad78u, 0x7fab5e8cu, 0x8dc0dd8fu,
+        0xe330a81au, 0x115b2b19u, 0x020bd8edu, 0xf0605beeu, 0x24aa3f05u, 0xd6c1bc06u, 0xc5914ff2u, 0x37faccf1u,
+        0x69e9f0d5u, 0x9b8273d6u, 0x88d28022u, 0x7ab90321u, 0xae7367cau, 0x5c18e4c9u, 0x4f48173du, 0xbd23943eu,
+        0xf36e6f75u, 0x0105ec76u, 0x12551f82u, 0xe03e9c81u, 0x34f4f86au, 0xc69f7b69u, 0xd5cf889du, 0x27a40b9eu,
+        0x79b737bau, 0x8bdcb4b9u, 0x988c474du, 0x6ae7c44eu, 0xbe2da0a5u, 0x4c4623a6u, 0x5f16d052u, 0xad7d5351u
+    },
+    {
+        0x00000000u, 0x13a29877u, 0x274530eeu, 0x34e7a899u, 0x4e8a61dcu, 0x5d28f9abu, 0x69cf5132u, 0x7a6dc945u,
+        0x9d14c3b8u, 0x8eb65bcfu, 0xba51f356u, 0xa9f36b21u, 0xd39ea264u, 0xc03c3a13u, 0xf4db928au, 0xe7790afdu,
+        0x3fc5f181u, 0x2c6769f6u, 0x1880c16fu, 0x0b225918u, 0x714f905du, 0x62ed082au, 0x560aa0b3u, 0x45a838c4u,
+        0xa2d13239u, 0xb173aa4eu, 0x859402d7u, 0x96369aa0u, 0xec5b53e5u, 0xfff9cb92u, 0xcb1e630bu, 0xd8bcfb7cu,
+        0x7f8be302u, 0x6c297b75u, 0x58ced3ecu, 0x4b6c4b9bu, 0x310182deu, 0x22a31aa9u, 0x1644b230u, 0x05e62a47u,
+        0xe29f20bau, 0xf13db8cdu, 0xc5da1054u, 0xd6788823u, 0xac154166u, 0xbfb7d911u, 0x8b507188u, 0x98f2e9ffu,
+        0x404e1283u, 0x53ec8af4u, 0x670b226du, 0x74a9ba1au, 0x0ec4735fu, 0x1d66eb28u, 0x298143b1u, 0x3a23dbc6u,
+        0xdd5ad13bu, 0xcef8494cu, 0xfa1fe1d5u, 0xe9bd79a2u, 0x93d0b0e7u, 0x80722890u, 0xb4958009u, 0xa737187eu,
+        0xff17c604u, 0xecb55e73u, 0xd852f6eau, 0xcbf06e9du, 0xb19da7d8u, 0xa23f3fafu, 0x96d89736u, 0x857a0f41u,
+        0x620305bcu, 0x71a19dcbu, 0x45463552u, 0x56e4ad25u, 0x2c896460u, 0x3f2bfc17u, 0x0bcc548eu, 0x186eccf9u,
+        0xc0d23785u, 0xd370aff2u, 0xe797076bu, 0xf4359f1cu, 0x8e585659u, 0x9dface2eu, 0xa91d66b7u, 0xbabffec0u,
+        0x5dc6f43du, 0x4e646c4au, 0x7a83c4d3u, 0x69215ca4u, 0x134c95e1u, 0x00ee0d96u, 0x3409a50fu, 0x27ab3d78u,
+        0x809c2506u, 0x933ebd71u, 0xa7d915e8u, 0xb47b8d9fu, 0xce1644dau, 0xddb4dcadu, 0xe9537434u, 0xfaf1ec43u,
+        0x1d88e6beu, 0x0e2a7ec9u, 0x3acdd650u, 0x296f4e27u, 0x53028762u, 0x40a01f15u, 0x7447b78cu, 0x67e52ffbu,
+        0xbf59d487u, 0xacfb4cf0u, 0x981ce469u, 0x8bbe7c1eu, 0xf1d3b55bu, 0xe2712d2cu, 0xd69685b5u, 0xc5341dc2u,
+        0x224d173fu, 0x31ef8f48u, 0x050827d1u, 0x16aabfa6u, 0x6cc776e3u, 0x7f65ee94u, 0x4b82460du, 0x5820de7au,
+        0xfbc3faf9u, 0xe861628eu, 0xdc86ca17u, 0xcf245260u, 0xb5499b25u, 0xa6eb0352u, 0x920cabcbu, 0x81ae33bcu,
+        0x66d73941u, 0x7575a136u, 0x419209afu, 0x523091d8u, 0x285d589du, 0x3bffc0eau, 0x0f186873u, 0x1cbaf004u,
+        0xc4060b78u, 0xd7a4930fu, 0xe3433b96u, 0xf0e1a3e1u, 0x8a8c6aa4u, 0x992ef2d3u, 0xadc95a4au, 0xbe6bc23du,
+        0x5912c8c0u, 0x4ab050b7u, 0x7e57f82eu, 0x6df56059u, 0x1798a91cu, 0x043a316bu, 0x30dd99f2u, 0x237f0185u,
+        0x844819fbu, 0x97ea818cu, 0xa30d2915u, 0xb0afb162u, 0xcac27827u, 0xd960e050u, 0xed8748c9u, 0xfe25d0beu,
+        0x195cda43u, 0x0afe4234u, 0x3e19eaadu, 0x2dbb72dau, 0x57d6bb9fu, 0x447423e8u, 0x70938b71u, 0x63311306u,
+        0xbb8de87au, 0xa82f700du, 0x9cc8d894u, 0x8f6a40e3u, 0xf50789a6u, 0xe6a511d1u, 0xd242b948u, 0xc1e0213fu,
+        0x26992bc2u, 0x353bb3b5u, 0x01dc1b2cu, 0x127e835bu, 0x68134a1eu, 0x7bb1d269u, 0x4f567af0u, 0x5cf4e287u,
+        0x04d43cfdu, 0x1776a48au, 0x23910c13u, 0x30339464u, 0x4a5e5d21u, 0x59fcc556u, 0x6d1b6dcfu, 0x7eb9f5b8u,
+        0x99c0ff45u, 0x8a626732u, 0xbe85cfabu, 0xad2757dcu, 0xd74a9e99u, 0xc4e806eeu, 0xf00fae77u, 0xe3ad3600u,
+        0x3b11cd7cu, 0x28b3550bu, 0x1c54fd92u, 0x0ff665e5u, 0x759baca0u, 0x663934d7u, 0x52de9c4eu, 0x417c0439u,
+        0xa6050ec4u, 0xb5a796b3u, 0x81403e2au, 0x92e2a65du, 0xe88f6f18u, 0xfb2df76fu, 0xcfca5ff6u, 0xdc68c781u,
+        0x7b5fdfffu, 0x68fd4788u, 0x5c1aef11u, 0x4fb87766u, 0x35d5be23u, 0x26772654u, 0x12908ecdu, 0x013216bau,
+        0xe64b1c47u, 0xf5e98430u, 0xc10e2ca9u, 0xd2acb4deu, 0xa8c17d9bu, 0xbb63e5ecu, 0x8f844d75u, 0x9c26d502u,
+        0x449a2e7eu, 0x5738b609u, 0x63df1e90u, 0x707d86e7u, 0x0a104fa2u, 0x19b2d7d5u, 0x2d557f4cu, 0x3ef7e73bu,
+        0xd98eedc6u, 0xca2c75b1u, 0xfecbdd28u, 0xed69455fu, 0x97048c1au, 0x84a6146du, 0xb041bcf4u, 0xa3e32483u
+    },
+    {
+        0x00000000u, 0xa541927eu, 0x4f6f520du, 0xea2ec073u, 0x9edea41au, 0x3b9f3664u, 0xd1b1f617u, 0x74f06469u,
+        0x38513ec5u, 0x9d10acbbu, 0x773e6cc8u, 0xd27ffeb6u, 0xa68f9adfu, 0x03ce08a1u, 0xe9e0c8d2u, 0x4ca15aacu,
+        0x70a27d8au, 0xd5e3eff4u, 0x3fcd2f87u, 0x9a8cbdf9u, 0xee7cd990u, 0x4b3d4beeu, 0xa1138b9du, 0x045219e3u,
+        0x48f3434fu, 0xedb2d131u, 0x079c1142u, 0xa2dd833cu, 0xd62de755u, 0x736c752bu, 0x9942b558u, 0x3c032726u,
+        0xe144fb14u, 0x4405696au, 0xae2ba919u, 0x0b6a3b67u, 0x7f9a5f0eu, 0xdadbcd70u, 0x30f50d03u, 0x95b49f7du,
+        0xd915c5d1u, 0x7c5457afu, 0x967a97dcu, 0x333b05a2u, 0x47cb61cbu, 0xe28af3b5u, 0x08a433c6u, 0xade5a1b8u,
+        0x91e6869eu, 0x34a714e0u, 0xde89d493u, 0x7bc846edu, 0x0f382284u, 0xaa79b0fau, 0x40577089u, 0xe516e2f7u,
+        0xa9b7b85bu, 0x0cf62a25u, 0xe6d8ea56u, 0x43997828u, 0x37691c41u, 0x92288e3fu, 0x78064e4cu, 0xdd47dc32u,
+        0xc76580d9u, 0x622412a7u, 0x880ad2d4u, 0x2d4b40aau, 0x59bb24c3u, 0xfcfab6bdu, 0x16d476ceu, 0xb395e4b0u,
+        0xff34be1cu, 0x5a752c62u, 0xb05bec11u, 0x151a7e6fu, 0x61ea1a06u, 0xc4ab8878u, 0x2e85480bu, 0x8bc4da75u,
+        0xb7c7fd53u, 0x12866f2du, 0xf8a8af5eu, 0x5de93d20u, 0x29195949u, 0x8c58cb37u, 0x66760b44u, 0xc337993au,
+        0x8f96c396u, 0x2ad751e8u, 0xc0f9919bu, 0x65b803e5u, 0x1148678cu, 0xb409f5f2u, 0x5e273581u, 0xfb66a7ffu,
+        0x26217bcdu, 0x8360e9b3u, 0x694e29c0u, 0xcc0fbbbeu, 0xb8ffdfd7u, 0x1dbe4da9u, 0xf7908ddau, 0x52d11fa4u,
+        0x1e704508u, 0xbb31d776u, 0x511f1705u, 0xf45e857bu, 0x80aee112u, 0x25ef736cu, 0xcfc1b31fu, 0x6a802161u,
+        0x56830647u, 0xf3c29439u, 0x19ec544au, 0xbcadc634u, 0xc85da25du, 0x6d1c3023u, 0x8732f050u, 0x2273622eu,
+        0x6ed23882u, 0xcb93aafcu, 0x21bd6a8fu, 0x84fcf8f1u, 0xf00c9c98u, 0x554d0ee6u, 0xbf63ce95u, 0x1a225cebu,
+        0x8b277743u, 0x2e66e53du, 0xc448254eu, 0x6109b730u, 0x15f9d359u, 0xb0b84127u, 0x5a968154u, 0xffd7132au,
+        0xb3764986u, 0x1637dbf8u, 0xfc191b8bu, 0x595889f5u, 0x2da8ed9cu, 0x88e97fe2u, 0x62c7bf91u, 0xc7862defu,
+        0xfb850ac9u, 0x5ec498b7u, 0xb4ea58c4u, 0x11abcabau, 0x655baed3u, 0xc01a3cadu, 0x2a34fcdeu, 0x8f756ea0u,
+        0xc3d4340cu, 0x6695a672u, 0x8cbb6601u, 0x29faf47fu, 0x5d0a9016u, 0xf84b0268u, 0x1265c21bu, 0xb7245065u,
+        0x6a638c57u, 0xcf221e29u, 0x250cde5au, 0x804d4c24u, 0xf4bd284du, 0x51fcba33u, 0xbbd27a40u, 0x1e93e83eu,
+        0x5232b292u, 0xf77320ecu, 0x1d5de09fu, 0xb81c72e1u, 0xccec1688u, 0x69ad84f6u, 0x83834485u, 0x26c2d6fbu,
+        0x1ac1f1ddu, 0xbf8063a3u, 0x55aea3d0u, 0xf0ef31aeu, 0x841f55c7u, 0x215ec7b9u, 0xcb7007cau, 0x6e3195b4u,
+        0x2290cf18u, 0x87d15d66u, 0x6dff9d15u, 0xc8be0f6bu, 0xbc4e6b02u, 0x190ff97cu, 0xf321390fu, 0x5660ab71u,
+        0x4c42f79au, 0xe90365e4u, 0x032da597u, 0xa66c37e9u, 0xd29c5380u, 0x77ddc1feu, 0x9df3018du, 0x38b293f3u,
+        0x7413c95fu, 0xd1525b21u, 0x3b7c9b52u, 0x9e3d092cu, 0xeacd6d45u, 0x4f8cff3bu, 0xa5a23f48u, 0x00e3ad36u,
+        0x3ce08a10u, 0x99a1186eu, 0x738fd81du, 0xd6ce4a63u, 0xa23e2e0au, 0x077fbc74u, 0xed517c07u, 0x4810ee79u,
+        0x04b1b4d5u, 0xa1f026abu, 0x4bdee6d8u, 0xee9f74a6u, 0x9a6f10cfu, 0x3f2e82b1u, 0xd50042c2u, 0x7041d0bcu,
+        0xad060c8eu, 0x08479ef0u, 0xe2695e83u, 0x4728ccfdu, 0x33d8a894u, 0x96993aeau, 0x7cb7fa99u, 0xd9f668e7u,
+        0x9557324bu, 0x3016a035u, 0xda386046u, 0x7f79f238u, 0x0b899651u, 0xaec8042fu, 0x44e6c45cu, 0xe1a75622u,
+        0xdda47104u, 0x78e5e37au, 0x92cb2309u, 0x378ab177u, 0x437ad51eu, 0xe63b4760u, 0x0c158713u, 0xa954156du,
+        0xe5f54fc1u, 0x40b4ddbfu, 0xaa9a1dccu, 0x0fdb8fb2u, 0x7b2bebdbu, 0xde6a79a5u, 0x3444b9d6u, 0x91052ba8u
+    },
+    {
+        0x00000000u, 0xdd45aab8u, 0xbf672381u, 0x62228939u, 0x7b2231f3u, 0xa6679b4bu, 0xc4451272u, 0x1900b8cau,
+        0xf64463e6u, 0x2b01c95eu, 0x49234067u, 0x9466eadfu, 0x8d665215u, 0x5023f8adu, 0x32017194u, 0xef44db2cu,
+        0xe964b13du, 0x34211b85u, 0x560392bcu, 0x8b463804u, 0x924680ceu, 0x4f032a76u, 0x2d21a34fu, 0xf06409f7u,
+        0x1f20d2dbu, 0xc2657863u, 0xa047f15au, 0x7d025be2u, 0x6402e328u, 0xb9474990u, 0xdb65c0a9u, 0x06206a11u,
+        0xd725148bu, 0x0a60be33u, 0x6842370au, 0xb5079db2u, 0xac072578u, 0x71428fc0u, 0x136006f9u, 0xce25ac41u,
+        0x2161776du, 0xfc24ddd5u, 0x9e0654ecu, 0x4343fe54u, 0x5a43469eu, 0x8706ec26u, 0xe524651fu, 0x3861cfa7u,
+        0x3e41a5b6u, 0xe3040f0eu, 0x81268637u, 0x5c632c8fu, 0x45639445u, 0x98263efdu, 0xfa04b7c4u, 0x27411d7cu,
+        0xc805c650u, 0x15406ce8u, 0x7762e5d1u, 0xaa274f69u, 0xb327f7a3u, 0x6e625d1bu, 0x0c40d422u, 0xd1057e9au,
+        0xaba65fe7u, 0x76e3f55fu, 0x14c17c66u, 0xc984d6deu, 0xd0846e14u, 0x0dc1c4acu, 0x6fe34d95u, 0xb2a6e72du,
+        0x5de23c01u, 0x80a796b9u, 0xe2851f80u, 0x3fc0b538u, 0x26c00df2u, 0xfb85a74au, 0x99a72e73u, 0x44e284cbu,
+        0x42c2eedau, 0x9f874462u, 0xfda5cd5bu, 0x20e067e3u, 0x39e0df29u, 0xe4a57591u, 0x8687fca8u, 0x5bc25610u,
+        0xb4868d3cu, 0x69c32784u, 0x0be1aebdu, 0xd6a40405u, 0xcfa4bccfu, 0x12e11677u, 0x70c39f4eu, 0xad8635f6u,
+        0x7c834b6cu, 0xa1c6e1d4u, 0xc3e468edu, 0x1ea1c255u, 0x07a17a9fu, 0xdae4d027u, 0xb8c6591eu, 0x6583f3a6u,
+        0x8ac7288au, 0x57828232u, 0x35a00b0bu, 0xe8e5a1b3u, 0xf1e51979u, 0x2ca0b3c1u, 0x4e823af8u, 0x93c79040u,
+        0x95e7fa51u, 0x48a250e9u, 0x2a80d9d0u, 0xf7c57368u, 0xeec5cba2u, 0x3380611au, 0x51a2e823u, 0x8ce7429bu,
+        0x63a399b7u, 0xbee6330fu, 0xdcc4ba36u, 0x0181108eu, 0x1881a844u, 0xc5c402fcu, 0xa7e68bc5u, 0x7aa3217du,
+        0x52a0c93fu, 0x8fe56387u, 0xedc7eabeu, 0x30824006u, 0x2982f8ccu, 0xf4c75274u, 0x96e5db4du, 0x4ba071f5u,
+        0xa4e4aad9u, 0x79a10061u, 0x1b838958u, 0xc6c623e0u, 0xdfc69b2au, 0x02833192u, 0x60a1b8abu, 0xbde41213u,
+        0xbbc47802u, 0x6681d2bau, 0x04a35b83u, 0xd9e6f13bu, 0xc0e649f1u, 0x1da3e349u, 0x7f816a70u, 0xa2c4c0c8u,
+        0x4d801be4u, 0x90c5b15cu, 0xf2e73865u, 0x2fa292ddu, 0x36a22a17u, 0xebe780afu, 0x89c50996u, 0x5480a32eu,
+        0x8585ddb4u, 0x58c0770cu, 0x3ae2fe35u, 0xe7a7548du, 0xfea7ec47u, 0x23e246ffu, 0x41c0cfc6u, 0x9c85657eu,
+        0x73c1be52u, 0xae8414eau, 0xcca69dd3u, 0x11e3376bu, 0x08e38fa1u, 0xd5a62519u, 0xb784ac20u, 0x6ac10698u,
+        0x6ce16c89u, 0xb1a4c631u, 0xd3864f08u, 0x0ec3e5b0u, 0x17c35d7au, 0xca86f7c2u, 0xa8a47efbu, 0x75e1d443u,
+        0x9aa50f6fu, 0x47e0a5d7u, 0x25c22ceeu, 0xf8878656u, 0xe1873e9cu, 0x3cc29424u, 0x5ee01d1du, 0x83a5b7a5u,
+        0xf90696d8u, 0x24433c60u, 0x4661b559u, 0x9b241fe1u, 0x8224a72bu, 0x5f610d93u, 0x3d4384aau, 0xe0062e12u,
+        0x0f42f53eu, 0xd2075f86u, 0xb025d6bfu, 0x6d607c07u, 0x7460c4cdu, 0xa9256e75u, 0xcb07e74cu, 0x16424df4u,
+        0x106227e5u, 0xcd278d5du, 0xaf050464u, 0x7240aedcu, 0x6b401616u, 0xb605bcaeu, 0xd4273597u, 0x09629f2fu,
+        0xe6264403u, 0x3b63eebbu, 0x59416782u, 0x8404cd3au, 0x9d0475f0u, 0x4041df48u, 0x22635671u, 0xff26fcc9u,
+        0x2e238253u, 0xf36628ebu, 0x9144a1d2u, 0x4c010b6au, 0x5501b3a0u, 0x88441918u, 0xea669021u, 0x37233a99u,
+        0xd867e1b5u, 0x05224b0du, 0x6700c234u, 0xba45688cu, 0xa345d046u, 0x7e007afeu, 0x1c22f3c7u, 0xc167597fu,
+        0xc747336eu, 0x1a0299d6u, 0x782010efu, 0xa565ba57u, 0xbc65029du, 0x6120a825u, 0x0302211cu, 0xde478ba4u,
+        0x31035088u, 0xec46fa30u, 0x8e647309u, 0x5321d9b1u, 0x4a21617bu, 0x9764cbc3u, 0xf54642fau, 0x2803e842u
+    },
+    {
+        0x00000000u, 0x38116facu, 0x7022df58u, 0x4833b0f4u, 0xe045beb0u, 0xd854d11cu, 0x906761e8u, 0xa8760e44u,
+        0xc5670b91u, 0xfd76643du, 0xb545d4c9u, 0x8d54bb65u, 0x2522b521u, 0x1d33da8du, 0x55006a79u, 0x6d1105d5u,
+        0x8f2261d3u, 0xb7330e7fu, 0xff00be8bu, 0xc711d127u, 0x6f67df63u, 0x5776b0cfu, 0x1f45003bu, 0x27546f97u,
+        0x4a456a42u, 0x725405eeu, 0x3a67b51au, 0x0276dab6u, 0xaa00d4f2u, 0x9211bb5eu, 0xda220baau, 0xe2336406u,
+        0x1ba8b557u, 0x23b9dafbu, 0x6b8a6a0fu, 0x539b05a3u, 0xfbed0be7u, 0xc3fc644bu, 0x8bcfd4bfu, 0xb3debb13u,
+        0xdecfbec6u, 0xe6ded16au, 0xaeed619eu, 0x96fc0e32u, 0x3e8a0076u, 0x069b6fdau, 0x4ea8df2eu, 0x76b9b082u,
+        0x948ad484u, 0xac9bbb28u, 0xe4a80bdcu, 0xdcb96470u, 0x74cf6a34u, 0x4cde0598u, 0x04edb56cu, 0x3cfcdac0u,
+        0x51eddf15u, 0x69fcb0b9u, 0x21cf004du, 0x19de6fe1u, 0xb1a861a5u, 0x89b90e09u, 0xc18abefdu, 0xf99bd151u,
+        0x37516aaeu, 0x0f400502u, 0x4773b5f6u, 0x7f62da5au, 0xd714d41eu, 0xef05bbb2u, 0xa7360b46u, 0x9f2764eau,
+        0xf236613fu, 0xca270e93u, 0x8214be67u, 0xba05d1cbu, 0x1273df8fu, 0x2a62b023u, 0x625100d7u, 0x5a406f7bu,
+        0xb8730b7du, 0x806264d1u, 0xc851d425u, 0xf040bb89u, 0x5836b5cdu, 0x6027da61u, 0x28146a95u, 0x10050539u,
+        0x7d1400ecu, 0x45056f40u, 0x0d36dfb4u, 0x3527b018u, 0x9d51be5cu, 0xa540d1f0u, 0xed736104u, 0xd5620ea8u,
+        0x2cf9dff9u, 0x14e8b055u, 0x5cdb00a1u, 0x64ca6f0du, 0xccbc6149u, 0xf4ad0ee5u, 0xbc9ebe11u, 0x848fd1bdu,
+        0xe99ed468u, 0xd18fbbc4u, 0x99bc0b30u, 0xa1ad649cu, 0x09db6ad8u, 0x31ca0574u, 0x79f9b580u, 0x41e8da2cu,
+        0xa3dbbe2au, 0x9bcad186u, 0xd3f96172u, 0xebe80edeu, 0x439e009au, 0x7b8f6f36u, 0x33bcdfc2u, 0x0badb06eu,
+        0x66bcb5bbu, 0x5eadda17u, 0x169e6ae3u, 0x2e8f054fu, 0x86f90b0bu, 0xbee864a7u, 0xf6dbd453u, 0xcecabbffu,
+        0x6ea2d55cu, 0x56b3baf0u, 0x1e800a04u, 0x269165a8u, 0x8ee76becu, 0xb6f60440u, 0xfec5b4b4u, 0xc6d4db18u,
+        0xabc5decdu, 0x93d4b161u, 0xdbe70195u, 0xe3f66e39u, 0x4b80607du, 0x73910fd1u, 0x3ba2bf25u, 0x03b3d089u,
+        0xe180b48fu, 0xd991db23u, 0x91a26bd7u, 0xa9b3047bu, 0x01c50a3fu, 0x39d46593u, 0x71e7d567u, 0x49f6bacbu,
+        0x24e7bf1eu, 0x1cf6d0b2u, 0x54c56046u, 0x6cd40feau, 0xc4a201aeu, 0xfcb36e02u, 0xb480def6u, 0x8c91b15au,
+        0x750a600bu, 0x4d1b0fa7u, 0x0528bf53u, 0x3d39d0ffu, 0x954fdebbu, 0xad5eb117u, 0xe56d01e3u, 0xdd7c6e4fu,
+        0xb06d6b9au, 0x887c0436u, 0xc04fb4c2u, 0xf85edb6eu, 0x5028d52au, 0x6839ba86u, 0x200a0a72u, 0x181b65deu,
+        0xfa2801d8u, 0xc2396e74u, 0x8a0ade80u, 0xb21bb12cu, 0x1a6dbf68u, 0x227cd0c4u, 0x6a4f6030u, 0x525e0f9cu,
+        0x3f4f0a49u, 0x075e65e5u, 0x4f6dd511u, 0x777cbabdu, 0xdf0ab4f9u, 0xe71bdb55u, 0xaf286ba1u, 0x9739040du,
+        0x59f3bff2u, 0x61e2d05eu, 0x29d160aau, 0x11c00f06u, 0xb9b60142u, 0x81a76eeeu, 0xc994de1au, 0xf185b1b6u,
+        0x9c94b463u, 0xa485dbcfu, 0xecb66b3bu, 0xd4a70497u, 0x7cd10ad3u, 0x44c0657fu, 0x0cf3d58bu, 0x34e2ba27u,
+        0xd6d1de21u, 0xeec0b18du, 0xa6f30179u, 0x9ee26ed5u, 0x36946091u, 0x0e850f3du, 0x46b6bfc9u, 0x7ea7d065u,
+        0x13b6d5b0u, 0x2ba7ba1cu, 0x63940ae8u, 0x5b856544u, 0xf3f36b00u, 0xcbe204acu, 0x83d1b458u, 0xbbc0dbf4u,
+        0x425b0aa5u, 0x7a4a6509u, 0x3279d5fdu, 0x0a68ba51u, 0xa21eb415u, 0x9a0fdbb9u, 0xd23c6b4du, 0xea2d04e1u,
+        0x873c0134u, 0xbf2d6e98u, 0xf71ede6cu, 0xcf0fb1c0u, 0x6779bf84u, 0x5f68d028u, 0x175b60dcu, 0x2f4a0f70u,
+        0xcd796b76u, 0xf56804dau, 0xbd5bb42eu, 0x854adb82u, 0x2d3cd5c6u, 0x152dba6au, 0x5d1e0a9eu, 0x650f6532u,
+        0x081e60e7u, 0x300f0f4bu, 0x783cbfbfu, 0x402dd013u, 0xe85bde57u, 0xd04ab1fbu, 0x9879010fu, 0xa0686ea3u
+    },
+    {
+        0x00000000u, 0xef306b19u, 0xdb8ca0c3u, 0x34bccbdau, 0xb2f53777u, 0x5dc55c6eu, 0x697997b4u, 0x8649fcadu,
+        0x6006181fu, 0x8f367306u, 0xbb8ab8dcu, 0x54bad3c5u, 0xd2f32f68u, 0x3dc34471u, 0x097f8fabu, 0xe64fe4b2u,
+        0xc00c303eu, 0x2f3c5b27u, 0x1b8090fdu, 0xf4b0fbe4u, 0x72f90749u, 0x9dc96c50u, 0xa975a78au, 0x4645cc93u,
+        0xa00a2821u, 0x4f3a4338u, 0x7b8688e2u, 0x94b6e3fbu, 0x12ff1f56u, 0xfdcf744fu, 0xc973bf95u, 0x2643d48cu,
+        0x85f4168du, 0x6ac47d94u, 0x5e78b64eu, 0xb148dd57u, 0x370121fau, 0xd8314ae3u, 0xec8d8139u, 0x03bdea20u,
+        0xe5f20e92u, 0x0ac2658bu, 0x3e7eae51u, 0xd14ec548u, 0x570739e5u, 0xb83752fcu, 0x8c8b9926u, 0x63bbf23fu,
+        0x45f826b3u, 0xaac84daau, 0x9e748670u, 0x7144ed69u, 0xf70d11c4u, 0x183d7addu, 0x2c81b107u, 0xc3b1da1eu,
+        0x25fe3eacu, 0xcace55b5u, 0xfe729e6fu, 0x1142f576u, 0x970b09dbu, 0x783b62c2u, 0x4c87a918u, 0xa3b7c201u,
+        0x0e045bebu, 0xe13430f2u, 0xd588fb28u, 0x3ab89031u, 0xbcf16c9cu, 0x53c10785u, 0x677dcc5fu, 0x884da746u,
+        0x6e0243f4u, 0x813228edu, 0xb58ee337u, 0x5abe882eu, 0xdcf77483u, 0x33c71f9au, 0x077bd440u, 0xe84bbf59u,
+        0xce086bd5u, 0x213800ccu, 0x1584cb16u, 0xfab4a00fu, 0x7cfd5ca2u, 0x93cd37bbu, 0xa771fc61u, 0x48419778u,
+        0xae0e73cau, 0x413e18d3u, 0x7582d309u, 0x9ab2b810u, 0x1cfb44bdu, 0xf3cb2fa4u, 0xc777e47eu, 0x28478f67u,
+        0x8bf04d66u, 0x64c0267fu, 0x507ceda5u, 0xbf4c86bcu, 0x39057a11u, 0xd6351108u, 0xe289dad2u, 0x0db9b1cbu,
+        0xebf65579u, 0x04c63e60u, 0x307af5bau, 0xdf4a9ea3u, 0x5903620eu, 0xb6330917u, 0x828fc2cdu, 0x6dbfa9d4u,
+        0x4bfc7d58u, 0xa4cc1641u, 0x9070dd9bu, 0x7f40b682u, 0xf9094a2fu, 0x16392136u, 0x2285eaecu, 0xcdb581f5u,
+        0x2bfa6547u, 0xc4ca0e5eu, 0xf076c584u, 0x1f46ae9du, 0x990f5230u, 0x763f3929u, 0x4283f2f3u, 0xadb399eau,
+        0x1c08b7d6u, 0xf338dccfu, 0xc7841715u, 0x28b47c0cu, 0xaefd80a1u, 0x41cdebb8u, 0x75712062u, 0x9a414b7bu,
+        0x7c0eafc9u, 0x933ec4d0u, 0xa7820f0au, 0x48b26413u, 0xcefb98beu, 0x21cbf3a7u, 0x1577387du, 0xfa475364u,
+        0xdc0487e8u, 0x3334ecf1u, 0x0788272bu, 0xe8b84c32u, 0x6ef1b09fu, 0x81c1db86u, 0xb57d105cu, 0x5a4d7b45u,
+        0xbc029ff7u, 0x5332f4eeu, 0x678e3f34u, 0x88be542du, 0x0ef7a880u, 0xe1c7c399u, 0xd57b0843u, 0x3a4b635au,
+        0x99fca15bu, 0x76ccca42u, 0x42700198u, 0xad406a81u, 0x2b09962cu, 0xc439fd35u, 0xf08536efu, 0x1fb55df6u,
+        0xf9fab944u, 0x16cad25du, 0x22761987u, 0xcd46729eu, 0x4b0f8e33u, 0xa43fe52au, 0x90832ef0u, 0x7fb345e9u,
+        0x59f09165u, 0xb6c0fa7cu, 0x827c31a6u, 0x6d4c5abfu, 0xeb05a612u, 0x0435cd0bu, 0x308906d1u, 0xdfb96dc8u,
+        0x39f6897au, 0xd6c6e263u, 0xe27a29b9u, 0x0d4a42a0u, 0x8b03be0du, 0x6433d514u, 0x508f1eceu, 0xbfbf75d7u,
+        0x120cec3du, 0xfd3c8724u, 0xc9804cfeu, 0x26b027e7u, 0xa0f9db4au, 0x4fc9b053u, 0x7b757b89u, 0x94451090u,
+        0x720af422u, 0x9d3a9f3bu, 0xa98654e1u, 0x46b63ff8u, 0xc0ffc355u, 0x2fcfa84cu, 0x1b736396u, 0xf443088fu,
+        0xd200dc03u, 0x3d30b71au, 0x098c7cc0u, 0xe6bc17d9u, 0x60f5eb74u, 0x8fc5806du, 0xbb794bb7u, 0x544920aeu,
+        0xb206c41cu, 0x5d36af05u, 0x698a64dfu, 0x86ba0fc6u, 0x00f3f36bu, 0xefc39872u, 0xdb7f53a8u, 0x344f38b1u,
+        0x97f8fab0u, 0x78c891a9u, 0x4c745a73u, 0xa344316au, 0x250dcdc7u, 0xca3da6deu, 0xfe816d04u, 0x11b1061du,
+        0xf7fee2afu, 0x18ce89b6u, 0x2c72426cu, 0xc3422975u, 0x450bd5d8u, 0xaa3bbec1u, 0x9e87751bu, 0x71b71e02u,
+        0x57f4ca8eu, 0xb8c4a197u, 0x8c786a4du, 0x63480154u, 0xe501fdf9u, 0x0a3196e0u, 0x3e8d5d3au, 0xd1bd3623u,
+        0x37f2d291u, 0xd8c2b988u, 0xec7e7252u, 0x034e194bu, 0x8507e5e6u, 0x6a378effu, 0x5e8b4525u, 0xb1bb2e3cu
+    },
+    {
+        0x00000000u, 0x68032cc8u, 0xd0065990u, 0xb8057558u, 0xa5e0c5d1u, 0xcde3e919u, 0x75e69c41u, 0x1de5b089u,
+        0x4e2dfd53u, 0x262ed19bu, 0x9e2ba4c3u, 0xf628880bu, 0xebcd3882u, 0x83ce144au, 0x3bcb6112u, 0x53c84ddau,
+        0x9c5bfaa6u, 0xf458d66eu, 0x4c5da336u, 0x245e8ffeu, 0x39bb3f77u, 0x51b813bfu, 0xe9bd66e7u, 0x81be4a2fu,
+        0xd27607f5u, 0xba752b3du, 0x02705e65u, 0x6a7372adu, 0x7796c224u, 0x1f95eeecu, 0xa7909bb4u, 0xcf93b77cu,
+        0x3d5b83bdu, 0x5558af75u, 0xed5dda2du, 0x855ef6e5u, 0x98bb466cu, 0xf0b86aa4u, 0x48bd1ffcu, 0x20be3334u,
+        0x73767eeeu, 0x1b755226u, 0xa370277eu, 0xcb730bb6u, 0xd696bb3fu, 0xbe9597f7u, 0x0690e2afu, 0x6e93ce67u,
+        0xa100791bu, 0xc90355d3u, 0x7106208bu, 0x19050c43u, 0x04e0bccau, 0x6ce39002u, 0xd4e6e55au, 0xbce5c992u,
+        0xef2d8448u, 0x872ea880u, 0x3f2bddd8u, 0x5728f110u, 0x4acd4199u, 0x22ce6d51u, 0x9acb1809u, 0xf2c834c1u,
+        0x7ab7077au, 0x12b42bb2u, 0xaab15eeau, 0xc2b27222u, 0xdf57c2abu, 0xb754ee63u, 0x0f519b3bu, 0x6752b7f3u,
+        0x349afa29u, 0x5c99d6e1u, 0xe49ca3b9u, 0x8c9f8f71u, 0x917a3ff8u, 0xf9791330u, 0x417c6668u, 0x297f4aa0u,
+        0xe6ecfddcu, 0x8eefd114u, 0x36eaa44cu, 0x5ee98884u, 0x430c380du, 0x2b0f14c5u, 0x930a619du, 0xfb094d55u,
+        0xa8c1008fu, 0xc0c22c47u, 0x78c7591fu, 0x10c475d7u, 0x0d21c55eu, 0x6522e996u, 0xdd279cceu, 0xb524b006u,
+        0x47ec84c7u, 0x2fefa80fu, 0x97eadd57u, 0xffe9f19fu, 0xe20c4116u, 0x8a0f6ddeu, 0x320a1886u, 0x5a09344eu,
+        0x09c17994u, 0x61c2555cu, 0xd9c72004u, 0xb1c40cccu, 0xac21bc45u, 0xc422908du, 0x7c27e5d5u, 0x1424c91du,
+        0xdbb77e61u, 0xb3b452a9u, 0x0bb127f1u, 0x63b20b39u, 0x7e57bbb0u, 0x16549778u, 0xae51e220u, 0xc652cee8u,
+        0x959a8332u, 0xfd99affau, 0x459cdaa2u, 0x2d9ff66au, 0x307a46e3u, 0x58796a2bu, 0xe07c1f73u, 0x887f33bbu,
+        0xf56e0ef4u, 0x9d6d223cu, 0x25685764u, 0x4d6b7bacu, 0x508ecb25u, 0x388de7edu, 0x808892b5u, 0xe88bbe7du,
+        0xbb43f3a7u, 0xd340df6fu, 0x6b45aa37u, 0x034686ffu, 0x1ea33676u, 0x76a01abeu, 0xcea56fe6u, 0xa6a6432eu,
+        0x6935f452u, 0x0136d89au, 0xb933adc2u, 0xd130810au, 0xccd53183u, 0xa4d61d4bu, 0x1cd36813u, 0x74d044dbu,
+        0x27180901u, 0x4f1b25c9u, 0xf71e5091u, 0x9f1d7c59u, 0x82f8ccd0u, 0xeafbe018u, 0x52fe9540u, 0x3afdb988u,
+        0xc8358d49u, 0xa036a181u, 0x1833d4d9u, 0x7030f811u, 0x6dd54898u, 0x05d66450u, 0xbdd31108u, 0xd5d03dc0u,
+        0x8618701au, 0xee1b5cd2u, 0x561e298au, 0x3e1d0542u, 0x23f8b5cbu, 0x4bfb9903u, 0xf3feec5bu, 0x9bfdc093u,
+        0x546e77efu, 0x3c6d5b27u, 0x84682e7fu, 0xec6b02b7u, 0xf18eb23eu, 0x998d9ef6u, 0x2188ebaeu, 0x498bc766u,
+        0x1a438abcu, 0x7240a674u, 0xca45d32cu, 0xa246ffe4u, 0xbfa34f6du, 0xd7a063a5u, 0x6fa516fdu, 0x07a63a35u,
+        0x8fd9098eu, 0xe7da2546u, 0x5fdf501eu, 0x37dc7cd6u, 0x2a39cc5fu, 0x423ae097u, 0xfa3f95cfu, 0x923cb907u,
+        0xc1f4f4ddu, 0xa9f7d815u, 0x11f2ad4du, 0x79f18185u, 0x6414310cu, 0x0c171dc4u, 0xb412689cu, 0xdc114454u,
+        0x1382f328u, 0x7b81dfe0u, 0xc384aab8u, 0xab878670u, 0xb66236f9u, 0xde611a31u, 0x66646f69u, 0x0e6743a1u,
+        0x5daf0e7bu, 0x35ac22b3u, 0x8da957ebu, 0xe5aa7b23u, 0xf84fcbaau, 0x904ce762u, 0x2849923au, 0x404abef2u,
+        0xb2828a33u, 0xda81a6fbu, 0x6284d3a3u, 0x0a87ff6bu, 0x17624fe2u, 0x7f61632au, 0xc7641672u, 0xaf673abau,
+        0xfcaf7760u, 0x94ac5ba8u, 0x2ca92ef0u, 0x44aa0238u, 0x594fb2b1u, 0x314c9e79u, 0x8949eb21u, 0xe14ac7e9u,
+        0x2ed97095u, 0x46da5c5du, 0xfedf2905u, 0x96dc05cdu, 0x8b39b544u, 0xe33a998cu, 0x5b3fecd4u, 0x333cc01cu,
+        0x60f48dc6u, 0x08f7a10eu, 0xb0f2d456u, 0xd8f1f89eu, 0xc5144817u, 0xad1764dfu, 0x15121187u, 0x7d113d4fu
+    },
+    {
+        0x00000000u, 0x493c7d27u, 0x9278fa4eu, 0xdb448769u, 0x211d826du, 0x6821ff4au, 0xb3657823u, 0xfa590504u,
+        0x423b04dau, 0x0b0779fdu, 0xd043fe94u, 0x997f83b3u, 0x632686b7u, 0x2a1afb90u, 0xf15e7cf9u, 0xb86201deu,
+        0x847609b4u, 0xcd4a7493u, 0x160ef3fau, 0x5f328eddu, 0xa56b8bd9u, 0xec57f6feu, 0x37137197u, 0x7e2f0cb0u,
+        0xc64d0d6eu, 0x8f717049u, 0x5435f720u, 0x1d098a07u, 0xe7508f03u, 0xae6cf224u, 0x7528754du, 0x3c14086au,
+        0x0d006599u, 0x443c18beu, 0x9f789fd7u, 0xd644e2f0u, 0x2c1de7f4u, 0x65219ad3u, 0xbe651dbau, 0xf759609du,
+        0x4f3b6143u, 0x06071c64u, 0xdd439b0du, 0x947fe62au, 0x6e26e32eu, 0x271a9e09u, 0xfc5e1960u, 0xb5626447u,
+        0x89766c2du, 0xc04a110au, 0x1b0e9663u, 0x5232eb44u, 0xa86bee40u, 0xe1579367u, 0x3a13140eu, 0x732f6929u,
+        0xcb4d68f7u, 0x827115d0u, 0x593592b9u, 0x1009ef9eu, 0xea50ea9au, 0xa36c97bdu, 0x782810d4u, 0x31146df3u,
+        0x1a00cb32u, 0x533cb615u, 0x8878317cu, 0xc1444c5bu, 0x3b1d495fu, 0x72213478u, 0xa965b311u, 0xe059ce36u,
+        0x583bcfe8u, 0x1107b2cfu, 0xca4335a6u, 0x837f4881u, 0x79264d85u, 0x301a30a2u, 0xeb5eb7cbu, 0xa262caecu,
+        0x9e76c286u, 0xd74abfa1u, 0x0c0e38c8u, 0x453245efu, 0xbf6b40ebu, 0xf6573dccu, 0x2d13baa5u, 0x642fc782u,
+        0xdc4dc65cu, 0x9571bb7bu, 0x4e353c12u, 0x07094135u, 0xfd504431u, 0xb46c3916u, 0x6f28be7fu, 0x2614c358u,
+        0x1700aeabu, 0x5e3cd38cu, 0x857854e5u, 0xcc4429c2u, 0x361d2cc6u, 0x7f2151e1u, 0xa465d688u, 0xed59abafu,
+        0x553baa71u, 0x1c07d756u, 0xc743503fu, 0x8e7f2d18u, 0x7426281cu, 0x3d1a553bu, 0xe65ed252u, 0xaf62af75u,
+        0x9376a71fu, 0xda4ada38u, 0x010e5d51u, 0x48322076u, 0xb26b2572u, 0xfb575855u, 0x2013df3cu, 0x692fa21bu,
+        0xd14da3c5u, 0x9871dee2u, 0x4335598bu, 0x0a0924acu, 0xf05021a8u, 0xb96c5c8fu, 0x6228dbe6u, 0x2b14a6c1u,
+        0x34019664u, 0x7d3deb43u, 0xa6796c2au, 0xef45110du, 0x151c1409u, 0x5c20692eu, 0x8764ee47u, 0xce589360u,
+        0x763a92beu, 0x3f06ef99u, 0xe44268f0u, 0xad7e15d7u, 0x572710d3u, 0x1e1b6df4u, 0xc55fea9du, 0x8c6397bau,
+        0xb0779fd0u, 0xf94be2f7u, 0x220f659eu, 0x6b3318b9u, 0x916a1dbdu, 0xd856609au, 0x0312e7f3u, 0x4a2e9ad4u,
+        0xf24c9b0au, 0xbb70e62du, 0x60346144u, 0x29081c63u, 0xd3511967u, 0x9a6d6440u, 0x4129e329u, 0x08159e0eu,
+        0x3901f3fdu, 0x703d8edau, 0xab7909b3u, 0xe2457494u, 0x181c7190u, 0x51200cb7u, 0x8a648bdeu, 0xc358f6f9u,
+        0x7b3af727u, 0x32068a00u, 0xe9420d69u, 0xa07e704eu, 0x5a27754au, 0x131b086du, 0xc85f8f04u, 0x8163f223u,
+        0xbd77fa49u, 0xf44b876eu, 0x2f0f0007u, 0x66337d20u, 0x9c6a7824u, 0xd5560503u, 0x0e12826au, 0x472eff4du,
+        0xff4cfe93u, 0xb67083b4u, 0x6d3404ddu, 0x240879fau, 0xde517cfeu, 0x976d01d9u, 0x4c2986b0u, 0x0515fb97u,
+        0x2e015d56u, 0x673d2071u, 0xbc79a718u, 0xf545da3fu, 0x0f1cdf3bu, 0x4620a21cu, 0x9d642575u, 0xd4585852u,
+        0x6c3a598cu, 0x250624abu, 0xfe42a3c2u, 0xb77edee5u, 0x4d27dbe1u, 0x041ba6c6u, 0xdf5f21afu, 0x96635c88u,
+        0xaa7754e2u, 0xe34b29c5u, 0x380faeacu, 0x7133d38bu, 0x8b6ad68fu, 0xc256aba8u, 0x19122cc1u, 0x502e51e6u,
+        0xe84c5038u, 0xa1702d1fu, 0x7a34aa76u, 0x3308d751u, 0xc951d255u, 0x806daf72u, 0x5b29281bu, 0x1215553cu,
+        0x230138cfu, 0x6a3d45e8u, 0xb179c281u, 0xf845bfa6u, 0x021cbaa2u, 0x4b20c785u, 0x906440ecu, 0xd9583dcbu,
+        0x613a3c15u, 0x28064132u, 0xf342c65bu, 0xba7ebb7cu, 0x4027be78u, 0x091bc35fu, 0xd25f4436u, 0x9b633911u,
+        0xa777317bu, 0xee4b4c5cu, 0x350fcb35u, 0x7c33b612u, 0x866ab316u, 0xcf56ce31u, 0x14124958u, 0x5d2e347fu,
+        0xe54c35a1u, 0xac704886u, 0x7734cfefu, 0x3e08b2c8u, 0xc451b7ccu, 0x8d6dcaebu, 0x56294d82u, 0x1f1530a5u
+    }
+};
+
+#ifdef CRC_SSE42
+// CRC-32C of count bytes with the SSE4.2 CRC instruction, 8 bytes at a time.
+// Only called once the processor is known to support it.
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(uint32_t crc, const uint8_t *srcPtr, uint16_t count)
+{
+    uint64_t value;
+    
+    for (; count >= sizeof(value); count -= sizeof(value))
+    {
+        memcpy(&value, srcPtr, sizeof(value));
+        crc = (uint32_t)_mm_crc32_u64(crc, value);
+        srcPtr += sizeof(value);
+    }
+    while (count-- != 0)
+    {
+        crc = _mm_crc32_u8(crc, *srcPtr++);
+    }
+    return crc;
+}
+#endif
+
+// CRC-32C of count bytes by slicing by 8: the next 8 bytes are looked up in
+// separate tables and combined, so there is no dependency from byte to byte.
+static uint32_t crc32c_table(uint32_t crc, const uint8_t *srcPtr, uint16_t count)
+{
+    uint32_t lo;                    // CRC combined with the first 4 bytes
+    uint32_t hi;                    // Following 4 bytes
+    
+    for (; count >= 8; count -= 8)
+    {
+        lo = crc ^ (srcPtr[0] | (uint32_t)srcPtr[1] << 8 | (uint32_t)srcPtr[2] << 16 | (uint32_t)srcPtr[3] << 24);
+        hi = srcPtr[4] | (uint32_t)srcPtr[5] << 8 | (uint32_t)srcPtr[6] << 16 | (uint32_t)srcPtr[7] << 24;
+        crc = crcTable[7][lo & 0xff] ^ crcTable[6][(lo >> 8) & 0xff] ^
+              crcTable[5][(lo >> 16) & 0xff] ^ crcTable[4][lo >> 24] ^
+              crcTable[3][hi & 0xff] ^ crcTable[2][(hi >> 8) & 0xff] ^
+              crcTable[1][(hi >> 16) & 0xff] ^ crcTable[0][hi >> 24];
+        srcPtr += 8;
+    }
+    while (count-- != 0)
+    {
+        crc = (crc >> 8) ^ crcTable[0][(crc ^ *srcPtr++) & 0xff];
+    }
+    return crc;
+}
+
+/*----------------------------------------------------------------------------
+packbits_crc32c updates a CRC-32C checksum with count more bytes. Start with
+a crc of 0. On x86-64 the SSE4.2 CRC instruction is used if the processor
+has it, whatever the compiler options, otherwise tables are used 8 bytes at
+a time.
+----------------------------------------------------------------------------*/
+uint32_t packbits_crc32c(uint32_t crc, const uint8_t *srcPtr, uint16_t count)
+{
+    crc = ~crc;
+#ifdef CRC_SSE42
+    if (__builtin_cpu_supports("sse4.2"))
+    {
+        return ~crc32c_sse42(crc, srcPtr, count);
+    }
+#endif
+    return ~crc32c_table(crc, srcPtr, count);
+}
+
+/*----------------------------------------------------------------------------
+packbits_frame compresses the source buffer to the destination buffer in
+blocks of blockSize bytes, or as a single block if blockSize is 0. A block
+is stored packed only if packing saves more than minGainPercent of its size,
+otherwise it is stored raw. If flags includes PACKBITS_FRAME_CHECKSUM, each
+block also records its unpacked length and CRC-32C so that corruption is
+detected when unpacking. If the destination buffer is not large enough,
+the function returns 0 and the destination buffer content is incomplete.
+
+If unconditional compression is required, the size of the destination
+buffer must be at least srcCount + 3 for each block, or srcCount + 9 for
+each block with a checksum.
+
+Return value is the size of destination buffer actually used.
+----------------------------------------------------------------------------*/
+uint16_t packbits_frame(const uint8_t *srcPtr, uint8_t *destPtr, uint16_t srcCount, uint16_t destLimit,
+                        uint16_t blockSize, uint8_t minGainPercent, uint8_t flags)
+{
+    uint16_t destCount = 0;             // Destination buffer used
+    uint16_t count;                     // Size of the current block
+    uint32_t minGain;                   // Bytes packing must save
+    uint16_t packLimit;                 // Largest packed size worth keeping
+    uint16_t packCount;                 // Packed size of the current block
+    uint8_t *blockPtr;                  // Frame header of the current block
+    uint8_t hdrSize = FRAME_HDR_SIZE;   // Size of each frame header
+    uint8_t tag = FRAME_PACKED;
+    uint32_t crc;
+    
+    if (flags & PACKBITS_FRAME_CHECKSUM)
+    {
+        hdrSize += FRAME_CHECK_SIZE;
+        tag |= FRAME_CHECKED;
+    }
+    if (blockSize == 0)
+    {
+        blockSize = srcCount;
+    }
+    while (srcCount != 0)
+    {
+        count = srcCount < blockSize ? srcCount : blockSize;
+        if (destCount + hdrSize > destLimit) return 0;
+        blockPtr = destPtr + destCount;
+        destCount += hdrSize;
+        
+        // Packing gives up as soon as the output passes the limit
+        minGain = (uint32_t)count * minGainPercent / 100;
+        packCount = 0;
+        if (minGain < count)
+        {
+            packLimit = count - 1 - (uint16_t)minGain;
+            if (packLimit > destLimit - destCount)
+            {
+                packLimit = destLimit - destCount;
+            }
+            packCount = packbits(srcPtr, blockPtr + hdrSize, count, packLimit);
+        }
+        if (packCount != 0)
+        {
+            blockPtr[0] = tag;
+        }
+        else
+        {
+            if (destCount + count > destLimit) return 0;
+            memcpy(blockPtr + hdrSize, srcPtr, count);
+            packCount = count;
+            blockPtr[0] = tag | FRAME_RAW;
+        }
+        blockPtr[1] = (uint8_t)packCount;
+        blockPtr[2] = (uint8_t)(packCount >> 8);
+        if (tag & FRAME_CHECKED)
+        {
+            crc = packbits_crc32c(0, srcPtr, count);
+            blockPtr[3] = (uint8_t)count;
+            blockPtr[4] = (uint8_t)(count >> 8);
+            blockPtr[5] = (uint8_t)crc;
+            blockPtr[6] = (uint8_t)(crc >> 8);
+            blockPtr[7] = (uint8_t)(crc >> 16);
+            blockPtr[8] = (uint8_t)(crc >> 24);
+        }
+        destCount += packCount;
+        srcPtr += count;
+        srcCount -= count;
+    }
+    return destCount;
+}
+
+/*----------------------------------------------------------------------------
+unpackbits_frame decompresses data packed by packbits_frame. Unpacking stops
+when either the source runs out or the destination is full.
+
+A block with a checksum is checked as soon as it has been unpacked, while it
+is still in cache, rather than in a second pass over the whole output. Such a
+block is only output whole, so unpacking stops before a checked block which
+does not fit in the destination. If the unpacked length or checksum of a
+block is wrong, the function returns 0.
+
+Return value is the unpacked size.
+----------------------------------------------------------------------------*/
+uint16_t unpackbits_frame(const uint8_t *srcPtr, uint8_t *destPtr, uint16_t srcCount, uint16_t destLimit)
+{
+    uint16_t destRemaining = destLimit; // Buffer size still available for unpacking into
+    uint16_t length;                    // Size of the data in the current block
+    uint16_t count;                     // Bytes output by the current block
+    uint16_t rawCount = 0;              // Recorded unpacked size of a checked block
+    uint32_t crc = 0;                   // Recorded checksum of a checked block
+    uint8_t tag;
+    
+    while ((srcCount >= FRAME_HDR_SIZE) && (destRemaining != 0))
+    {
+        tag = srcPtr[0];
+        length = srcPtr[1] | (uint16_t)(srcPtr[2] << 8);
+        srcPtr += FRAME_HDR_SIZE;
+        srcCount -= FRAME_HDR_SIZE;
+        if (tag & FRAME_CHECKED)
+        {
+            if (srcCount < FRAME_CHECK_SIZE) return 0;
+            rawCount = srcPtr[0] | (uint16_t)(srcPtr[1] << 8);
+            crc = srcPtr[2] | ((uint32_t)srcPtr[3] << 8) | ((uint32_t)srcPtr[4] << 16) | ((uint32_t)srcPtr[5] << 24);
+            srcPtr += FRAME_CHECK_SIZE;
+            srcCount -= FRAME_CHECK_SIZE;
+            if (rawCount > destRemaining) break;
+        }
+        if (length > srcCount)
+        {
+            length = srcCount;
+        }
+        if (tag & FRAME_RAW)
+        {
+            count = length < destRemaining ? length : destRemaining;
+            memcpy(destPtr, srcPtr, count);
+        }
+        else
+        {
+            count = length ? unpackbits(srcPtr, destPtr, length, destRemaining) : 0;
+        }
+        if ((tag & FRAME_CHECKED) && ((count != rawCount) || (packbits_crc32c(0, destPtr, count) != crc))) return 0;
+        destPtr += count;
+        destRemaining -= count;
+        srcPtr += length;
+        srcCount -= length;
+    }
+    return destLimit - destRemaining;
+}
+
+/*----------------------------------------------------------------------------
+Table driven unpacking.
+
+Each header byte is looked up to give the output length, the number of source
+bytes following the header and whether the run is repeated. A no operation
+header is treated as an empty literal block, so the unpacking loop has only
+one decision per header and no range tests.
+----------------------------------------------------------------------------*/
+
+typedef struct
+{
+    uint8_t length;                 // Bytes output
+    uint8_t advance;                // Source bytes following the header
+    bool repeat;                    // Run is repeated rather than literal
+} hdr_entry_t;
+
+#define HDR_LENGTH(h)       (IS_DIFF(h) ? DECODE_DIFF(h) : IS_REPT(h) ? DECODE_REPT(h) : 0)
+#define HDR_ADVANCE(h)      (IS_DIFF(h) ? DECODE_DIFF(h) : IS_REPT(h) ? 1 : 0)
+#define HDR_ENTRY(h)        { HDR_LENGTH(h), HDR_ADVANCE(h), IS_REPT(h) }
+#define HDR_ROW(h)          HDR_ENTRY(h),      HDR_ENTRY(h + 1),  HDR_ENTRY(h + 2),  HDR_ENTRY(h + 3),  \
+                            HDR_ENTRY(h + 4),  HDR_ENTRY(h + 5),  HDR_ENTRY(h + 6),  HDR_ENTRY(h + 7),  \
+                            HDR_ENTRY(h + 8),  HDR_ENTRY(h + 9),  HDR_ENTRY(h + 10), HDR_ENTRY(h + 11), \
+                            HDR_ENTRY(h + 12), HDR_ENTRY(h + 13), HDR_ENTRY(h + 14), HDR_ENTRY(h + 15)
+
+static const hdr_entry_t hdrTable[256] =
+{
+    HDR_ROW(0),   HDR_ROW(16),  HDR_ROW(32),  HDR_ROW(48),
+    HDR_ROW(64),  HDR_ROW(80),  HDR_ROW(96),  HDR_ROW(112),
+    HDR_ROW(128), HDR_ROW(144), HDR_ROW(160), HDR_ROW(176),
+    HDR_ROW(192), HDR_ROW(208), HDR_ROW(224), HDR_ROW(240),
+};
+
+#define UNROLL              4       // Headers unpacked per pass of the fast loop
+#define SHORT_RUN           16      // Runs up to this long are copied as a fixed size
+
+// Unpack one block with no checks. The caller ensures there is enough
+// source and destination for the largest block. Short runs are copied as a
+// fixed SHORT_RUN bytes, which compiles to a few wide moves rather than a
+// library call, and the excess is overwritten by the blocks which follow.
+static inline void unpack_block(const uint8_t **srcPtr, uint8_t **destPtr)
+{
+    const hdr_entry_t *entry = &hdrTable[**srcPtr];
+    
+    if (entry->length <= SHORT_RUN)
+    {
+        if (entry->repeat)
+        {
+            memset(*destPtr, (*srcPtr)[1], SHORT_RUN);
+        }
+        else
+        {
+            memcpy(*destPtr, *srcPtr + 1, SHORT_RUN);
+        }
+    }
+    else if (entry->repeat)
+    {
+        memset(*destPtr, (*srcPtr)[1], entry->length);
+    }
+    else
+    {
+        memcpy(*destPtr, *srcPtr + 1, entry->length);
+    }
+    *srcPtr += 1 + entry->advance;
+    *destPtr += entry->length;
+}
+
+/*----------------------------------------------------------------------------
+unpackbits_table decompresses exactly as unpackbits does, including the
+special case of a source size of 0, but is faster on data which mixes short
+repeated and literal runs. While there is room in both source and
+destination for several of the largest blocks, headers are decoded by table
+lookup without range checks, UNROLL at a time. The remainder is unpacked
+with full checks. With a source size of 0 the end of the source is not known,
+so all of it is unpacked with full checks.
+
+Destination bytes beyond the unpacked size, but within destLimit, may be
+overwritten.
+
+Return value is the unpacked size, or the number of source bytes used if
+srcCount is 0.
+----------------------------------------------------------------------------*/
+uint16_t unpackbits_table(const uint8_t *srcPtr, uint8_t *destPtr, uint16_t srcCount, uint16_t destLimit)
+{
+    const uint8_t *srcStart = srcPtr;
+    uint8_t *destStart = destPtr;
+    const uint8_t *srcFast;             // Fast loop may start a pass before here
+    uint8_t *destFast;
+    uint16_t srcRemaining;
+    packbits_state_t state;             // For the checked remainder
+    
+    srcRemaining = srcCount ? srcCount : 0xffff;
+    srcFast = srcPtr;
+    if (srcCount > UNROLL * MAX_EMIT + SHORT_RUN)
+    {
+        srcFast += srcCount - UNROLL * MAX_EMIT - SHORT_RUN;
+    }
+    destFast = destPtr + (destLimit > UNROLL * MAX_REPT ? destLimit - UNROLL * MAX_REPT : 0);
+    while ((srcPtr < srcFast) && (destPtr < destFast))
+    {
+        unpack_block(&srcPtr, &destPtr);
+        unpack_block(&srcPtr, &destPtr);
+        unpack_block(&srcPtr, &destPtr);
+        unpack_block(&srcPtr, &destPtr);
+    }
+    
+    state.srcPtr = srcPtr;
+    state.srcRemaining = srcRemaining - (uint16_t)(srcPtr - srcStart);
+    state.destPos = 0;
+    state.count = 0;
+    state.repeat = false;
+    destPtr += unpackbits_resume(&state, destPtr, destLimit - (uint16_t)(destPtr - destStart));
+    if (srcCount == 0)
+    {
+        return 0xffff - state.srcRemaining;     // Number of source bytes used
+    }
+    else
+    {
+        return (uint16_t)(destPtr - destStart); // Number of bytes actually output
+    }
+}
+
+/*----------------------------------------------------------------------------
+Parallel unpacking.
+
+A packed stream has no structure above the block headers, but the headers
+alone give the output position of every block. One quick pass over the
+headers can therefore divide the stream into ranges which start on header
+boundaries and which can be unpacked at the same time, for example by one
+thread per range, into disjoint parts of a single destination buffer.
+----------------------------------------------------------------------------*/
+
+// Find the size of the block at srcPtr, treating truncated blocks as
+// unpackbits does. Return value is the number of source bytes in the block
+// including the header, and its output size is given in length.
+static uint16_t block_size(const uint8_t *srcPtr, uint16_t srcRemaining, uint16_t *length)
+{
+    uint8_t hdr = *srcPtr;
+    uint8_t count = 0;
+    
+    --srcRemaining;
+    if (IS_DIFF(hdr))
+    {
+        count = DECODE_DIFF(hdr);
+        if (count > srcRemaining)
+        {
+            count = (uint8_t)srcRemaining;
+        }
+        *length = count;
+        return 1 + count;
+    }
+    if (IS_REPT(hdr) && (srcRemaining != 0))
+    {
+        *length = DECODE_REPT(hdr);
+        return 2;
+    }
+    *length = 0;
+    return 1;
+}
+
+/*----------------------------------------------------------------------------
+unpackbits_plan divides a packed stream into as many as maxRanges ranges of
+roughly equal unpacked size. Each range can then be unpacked independently
+by unpackbits_range, in any order or concurrently.
+
+Return value is the number of ranges used, which is fewer than maxRanges if
+the stream has too few blocks.
+----------------------------------------------------------------------------*/
+uint16_t unpackbits_plan(const uint8_t *srcPtr, uint16_t srcCount, packbits_range_t *ranges, uint16_t maxRanges)
+{
+    uint16_t srcPos = 0;            // Position in the packed stream
+    uint16_t destPos = 0;           // Position in the unpacked data
+    uint16_t length;                // Unpacked size of a block
+    uint32_t total = 0;             // Total unpacked size
+    uint32_t target;                // Unpacked size wanted in each range
+    uint16_t numRanges = 0;
+    packbits_range_t *range = ranges;
+    
+    if ((srcCount == 0) || (maxRanges == 0)) return 0;
+    
+    // First pass finds the unpacked size
+    while (srcPos < srcCount)
+    {
+        srcPos += block_size(srcPtr + srcPos, srcCount - srcPos, &length);
+        total += length;
+    }
+    target = (total + maxRanges - 1) / maxRanges;
+    
+    // Second pass ends each range on the first header boundary past its share
+    srcPos = 0;
+    while (srcPos < srcCount)
+    {
+        range = &ranges[numRanges++];
+        range->srcOffset = srcPos;
+        range->destOffset = destPos;
+        while ((srcPos < srcCount) && ((numRanges == maxRanges) || (destPos < numRanges * target)))
+        {
+            srcPos += block_size(srcPtr + srcPos, srcCount - srcPos, &length);
+            destPos += length;
+        }
+        range->srcCount = srcPos - range->srcOffset;
+        range->destCount = destPos - range->destOffset;
+    }
+    return numRanges;
+}
+
+/*----------------------------------------------------------------------------
+unpackbits_range unpacks one range found by unpackbits_plan. srcPtr and
+destPtr are the start of the whole packed stream and unpacked buffer.
+
+Return value is the unpacked size of the range.
+----------------------------------------------------------------------------*/
+uint16_t unpackbits_range(const uint8_t *srcPtr, uint8_t *destPtr, const packbits_range_t *range)
+{
+    if (range->srcCount == 0) return 0;
+    return unpackbits(srcPtr + range->srcOffset, destPtr + range->destOffset, range->srcCount, range->destCount);
+}
+
+/*----------------------------------------------------------------------------
+packbits_join appends one packed stream to another, repairing the seam so
+the result is a single valid stream close to the size packbits would give
+for the combined data. A run which was split between the two streams is
+merged back into one run, and two literal blocks either side of the seam are
+merged into one block, if the result fits in one header.
+
+This allows a large buffer to be packed in parallel: divide the source into
+chunks, pack each chunk with packbits at the same time, for example one
+thread per chunk, then join the chunks in order.
+
+destPtr holds the first stream of destCount bytes and srcPtr the second
+stream of srcCount bytes, which must not overlap the destination buffer.
+If the destination buffer is not large enough, the function returns 0 and
+the first stream is left unchanged.
+
+Return value is the size of the joined stream.
+----------------------------------------------------------------------------*/
+uint16_t packbits_join(uint8_t *destPtr, uint16_t destCount, const uint8_t *srcPtr, uint16_t srcCount, uint16_t destLimit)
+{
+    uint16_t pos = 0;               // Position in the first stream
+    uint16_t lastPos = 0;           // Header of the last block of the first stream
+    uint16_t lastLength = 0;        // Output size of that block
+    uint16_t length;                // Output size of a block
+    uint16_t size;                  // Source size of a block
+    uint8_t lastHdr;
+    uint8_t firstHdr;
+    
+    if ((srcCount == 0) || (destCount == 0))
+    {
+        if (destCount + srcCount > destLimit) return 0;
+        memcpy(destPtr + destCount, srcPtr, srcCount);
+        return destCount + srcCount;
+    }
+    
+    // Find the last block of the first stream, ignoring no operation headers
+    while (pos < destCount)
+    {
+        size = block_size(destPtr + pos, destCount - pos, &length);
+        if (length != 0)
+        {
+            lastPos = pos;
+            lastLength = length;
+        }
+        pos += size;
+    }
+    lastHdr = destPtr[lastPos];
+    firstHdr = srcPtr[0];
+    
+    if (IS_REPT(lastHdr) && IS_REPT(firstHdr) && (srcCount >= 2) && (destPtr[lastPos + 1] == srcPtr[1])
+        && (lastLength + DECODE_REPT(firstHdr) <= MAX_REPT))
+    {
+        // The same byte repeated either side of the seam
+        if (destCount + srcCount - 2 > destLimit) return 0;
+        destPtr[lastPos] = ENCODE_REPT(lastLength + DECODE_REPT(firstHdr));
+        srcPtr += 2;
+        srcCount -= 2;
+    }
+    else if (IS_DIFF(lastHdr) && (lastPos + 1 + lastLength == destCount) && IS_DIFF(firstHdr)
+        && (lastLength + DECODE_DIFF(firstHdr) <= MAX_DIFF))
+    {
+        // Literal blocks either side of the seam
+        if (destCount + srcCount - 1 > destLimit) return 0;
+        destPtr[lastPos] = ENCODE_DIFF(lastLength + DECODE_DIFF(firstHdr));
+        srcPtr += 1;
+        srcCount -= 1;
+    }
+    else
+    {
+        if (destCount + srcCount > destLimit) return 0;
+    }
+    memcpy(destPtr + destCount, srcPtr, srcCount);
+    return destCount + srcCount;
+}
+
+/*----------------------------------------------------------------------------
+Pipelined packing.
+
+The pipeline reads raw data, packs it and writes the packed stream with the
+three stages overlapped, so that the time spent waiting for input and output
+is hidden behind packing and the reverse. Reads and writes are started by
+callbacks which may complete at once or later, for example from an I/O
+completion interrupt or event loop, by calling packbits_pipe_read_done or
+packbits_pipe_write_done.
+
+Data passes through a fixed ring of slots, each with a raw buffer and a
+packed buffer, all in memory supplied by the caller. A read is only started
+when a slot is free, and a slot is only freed when its packed data has been
+written, so a slow writer holds back the reader. The packed output is a
+single stream identical to packing all the input with packbits.
+
+Each slot gives the input offset of its read and the output offset of its
+write, so the callbacks can use positional I/O such as pread/pwrite, POSIX
+AIO or io_uring with one operation in flight per slot. Reads and writes may
+then complete in any order. Positional reads must fill the whole block
+except at the end of the input, since each read is placed blockSize bytes
+after the one before.
+
+The pipeline is not thread safe. If completions are reported from an
+interrupt or another thread, the caller must serialise calls.
+----------------------------------------------------------------------------*/
+
+#define PIPE_CARRY          MAX_DIFF        // Room in front of each slot's raw data
+
+enum
+{
+    SLOT_FREE,                      // Available for reading
+    SLOT_READING,                   // Read in progress
+    SLOT_READ,                      // Raw data waiting to be packed
+    SLOT_PACKED,                    // Packed data waiting to be written
+    SLOT_WRITING                    // Write in progress
+};
+
+/*----------------------------------------------------------------------------
+packbits_pipe_init sets up a pipeline with numSlots slots, each taking up to
+blockSize bytes of raw data per read. memPtr must have room for numSlots
+times PACKBITS_PIPE_SLOT_SIZE(blockSize) bytes. Nothing is started until
+packbits_pipe_run is called.
+
+Return value is false if the parameters are unusable.
+----------------------------------------------------------------------------*/
+bool packbits_pipe_init(packbits_pipe_t *pipe, packbits_slot_t *slots, uint16_t numSlots,
+                        uint8_t *memPtr, uint16_t blockSize,
+                        packbits_pipe_fn read, packbits_pipe_fn write, void *user)
+{
+    uint16_t i;
+    
+    if ((numSlots == 0) || (blockSize == 0)) return false;
+    if ((uint32_t)PACKBITS_PIPE_SLOT_SIZE(blockSize) - PIPE_CARRY - blockSize > 0xffff) return false;
+    for (i = 0; i < numSlots; ++i)
+    {
+        slots[i].rawPtr = memPtr + PIPE_CARRY;
+        slots[i].packedPtr = memPtr + PIPE_CARRY + blockSize;
+        slots[i].rawCount = 0;
+        slots[i].packedCount = 0;
+        slots[i].state = SLOT_FREE;
+        memPtr += PACKBITS_PIPE_SLOT_SIZE(blockSize);
+    }
+    pipe->slots = slots;
+    pipe->numSlots = numSlots;
+    pipe->blockSize = blockSize;
+    pipe->read = read;
+    pipe->write = write;
+    pipe->user = user;
+    pipe->readSlot = 0;
+    pipe->packSlot = 0;
+    pipe->writeSlot = 0;
+    pipe->rawOffset = 0;
+    pipe->packedOffset = 0;
+    pipe->endOfInput = false;
+    pipe->running = false;
+    pipe->rerun = false;
+    pipe->carryCount = 0;
+    return true;
+}
+
+// Pack the raw data in a slot, or finish the stream if there is none. The
+// whole slot is packed in one go, but its last block is held back and copied
+// in front of the next slot's raw data, so that it can grow into that data
+// just as it would if the input were packed in one call.
+static void pipe_pack(packbits_pipe_t *pipe, packbits_slot_t *slot)
+{
+    packbits_slot_t *nextSlot = &pipe->slots[(pipe->packSlot + 1) % pipe->numSlots];
+    uint8_t *srcPtr = slot->rawPtr - pipe->carryCount;  // Held over bytes, then the raw data
+    uint16_t packedLimit = PACKBITS_PIPE_SLOT_SIZE(pipe->blockSize) - PIPE_CARRY - pipe->blockSize;
+    uint16_t pendingCount = 0;      // Bytes held back for the next slot
+    
+    if (slot->rawCount != 0)
+    {
+        // The packed buffer is large enough that packing cannot fail
+        slot->packedCount = pack_core(srcPtr, slot->packedPtr, pipe->carryCount + slot->rawCount, packedLimit,
+                                      MIN_REPT, 2, false, &pendingCount);
+        memmove(nextSlot->rawPtr - pendingCount, slot->rawPtr + slot->rawCount - pendingCount, pendingCount);
+        pipe->carryCount = pendingCount;
+    }
+    else
+    {
+        slot->packedCount = pack_core(srcPtr, slot->packedPtr, pipe->carryCount, packedLimit,
+                                      MIN_REPT, 2, false, NULL);
+        pipe->carryCount = 0;
+        pipe->endOfInput = true;
+    }
+    slot->packedOffset = pipe->packedOffset;
+    pipe->packedOffset += slot->packedCount;
+}
+
+/*----------------------------------------------------------------------------
+packbits_pipe_run moves the pipeline on as far as it can: packs slots which
+have been read, starts writes of packed slots in order and starts reads into
+free slots. It is called by the completion functions, so after the first
+call it only needs calling again if a callback could not start its I/O.
+----------------------------------------------------------------------------*/
+void packbits_pipe_run(packbits_pipe_t *pipe)
+{
+    packbits_slot_t *slot;
+    
+    // Callbacks which complete at once call back in here
+    if (pipe->running)
+    {
+        pipe->rerun = true;
+        return;
+    }
+    pipe->running = true;
+    do
+    {
+        pipe->rerun = false;
+        
+        // Pack in the order read
+        slot = &pipe->slots[pipe->packSlot];
+        while (slot->state == SLOT_READ)
+        {
+            pipe_pack(pipe, slot);
+            slot->state = SLOT_PACKED;
+            pipe->packSlot = (pipe->packSlot + 1) % pipe->numSlots;
+            slot = &pipe->slots[pipe->packSlot];
+        }
+        
+        // Write in the order packed
+        slot = &pipe->slots[pipe->writeSlot];
+        while (slot->state == SLOT_PACKED)
+        {
+            pipe->writeSlot = (pipe->writeSlot + 1) % pipe->numSlots;
+            if (slot->packedCount == 0)
+            {
+                slot->state = SLOT_FREE;
+            }
+            else
+            {
+                slot->state = SLOT_WRITING;
+                pipe->write(pipe->user, slot);
+            }
+            slot = &pipe->slots[pipe->writeSlot];
+        }
+        
+        // Read into free slots
+        slot = &pipe->slots[pipe->readSlot];
+        while (!pipe->endOfInput && (slot->state == SLOT_FREE))
+        {
+            pipe->readSlot = (pipe->readSlot + 1) % pipe->numSlots;
+            slot->state = SLOT_READING;
+            slot->rawCount = 0;
+            slot->rawOffset = pipe->rawOffset;
+            pipe->rawOffset += pipe->blockSize;
+            pipe->read(pipe->user, slot);
+            slot = &pipe->slots[pipe->readSlot];
+        }
+    } while (pipe->rerun);
+    pipe->running = false;
+}
+
+/*----------------------------------------------------------------------------
+packbits_pipe_read_done reports that a read has completed with count bytes
+of raw data in slot->rawPtr. A count of 0 means the end of the input.
+----------------------------------------------------------------------------*/
+void packbits_pipe_read_done(packbits_pipe_t *pipe, packbits_slot_t *slot, uint16_t count)
+{
+    slot->rawCount = count;
+    slot->state = SLOT_READ;
+    packbits_pipe_run(pipe);
+}
+
+/*----------------------------------------------------------------------------
+packbits_pipe_write_done reports that the packed data in a slot has been
+written and the slot can be reused.
+----------------------------------------------------------------------------*/
+void packbits_pipe_write_done(packbits_pipe_t *pipe, packbits_slot_t *slot)
+{
+    slot->state = SLOT_FREE;
+    packbits_pipe_run(pipe);
+}
+
+/*----------------------------------------------------------------------------
+packbits_pipe_finished returns true once the end of the input has been
+packed and all the packed data written.
+----------------------------------------------------------------------------*/
+bool packbits_pipe_finished(const packbits_pipe_t *pipe)
+{
+    uint16_t i;
+    
+    if (!pipe->endOfInput) return false;
+    for (i = 0; i < pipe->numSlots; ++i)
+    {
+        if (pipe->slots[i].state != SLOT_FREE) return false;
+    }
+    return true;
+}
+
+/*----------------------------------------------------------------------------
+Prediction filters.
+
+PackBits only packs exact repeats, so smooth gradients pack badly. Storing
+each byte as the difference from a prediction based on its neighbours turns
+a gradient into a run of identical small values. The filters are those used
+by TIFF and PNG:
+
+DELTA       Previous byte in the buffer
+HORIZONTAL  Same sample of the pixel to the left (TIFF predictor 2)
+UP          Same byte of the row above (PNG Up)
+PAETH       Left, above or above left, whichever is closest (PNG Paeth)
+
+When packing, the source is filtered a chunk at a time into a small buffer
+on the stack and packed from there, so the source is not changed. When
+unpacking, the data is unpacked in full and then unfiltered in place, one
+row at a time.
+----------------------------------------------------------------------------*/
+
+#define FILTER_CHUNK        1024            // Bytes filtered at a time when packing
+
+// Choose the PNG Paeth predictor from the neighbours to the left, above and
+// above left.
+static inline uint8_t paeth(uint8_t left, uint8_t up, uint8_t upLeft)
+{
+    int pa = up - upLeft;
+    int pb = left - upLeft;
+    int pc = pa + pb;
+    
+    pa = pa < 0 ? -pa : pa;
+    pb = pb < 0 ? -pb : pb;
+    pc = pc < 0 ? -pc : pc;
+    if ((pa <= pb) && (pa <= pc)) return left;
+    return (pb <= pc) ? up : upLeft;
+}
+
+// Fill in the defaults of a filter. DELTA is the same as HORIZONTAL with
+// single byte pixels and the whole buffer as one row, so it is turned into
+// that and needs no code of its own.
+static packbits_filter_t filter_resolve(const packbits_filter_t *filter)
+{
+    packbits_filter_t resolved = *filter;
+    
+    if (resolved.type == PACKBITS_FILTER_DELTA)
+    {
+        resolved.type = PACKBITS_FILTER_HORIZONTAL;
+        resolved.bytesPerPixel = 1;
+        resolved.rowLength = 0;
+    }
+    if (resolved.bytesPerPixel == 0)
+    {
+        resolved.bytesPerPixel = 1;
+    }
+    if (resolved.rowLength == 0)
+    {
+        resolved.rowLength = 0xffff;
+    }
+    return resolved;
+}
+
+// Filter columns x to end - 1 of the row at rowPtr into outPtr. upPtr is the
+// row above, or NULL on the first row where everything above counts as 0.
+static inline void filter_row(const packbits_filter_t *filter, const uint8_t *rowPtr, const uint8_t *upPtr,
+                              uint8_t *outPtr, uint16_t x, uint16_t end)
+{
+    uint16_t bpp = filter->bytesPerPixel;
+    uint8_t type = filter->type;
+    
+    if (upPtr == NULL)
+    {
+        // With nothing above, UP predicts 0 and PAETH predicts left
+        if (type == PACKBITS_FILTER_UP) type = PACKBITS_FILTER_NONE;
+        if (type == PACKBITS_FILTER_PAETH) type = PACKBITS_FILTER_HORIZONTAL;
+    }
+    switch (type)
+    {
+    case PACKBITS_FILTER_HORIZONTAL:
+        for (; (x < end) && (x < bpp); ++x)
+        {
+            *outPtr++ = rowPtr[x];
+        }
+        for (; x < end; ++x)
+        {
+            *outPtr++ = (uint8_t)(rowPtr[x] - rowPtr[x - bpp]);
+        }
+        break;
+    case PACKBITS_FILTER_UP:
+        for (; x < end; ++x)
+        {
+            *outPtr++ = (uint8_t)(rowPtr[x] - upPtr[x]);
+        }
+        break;
+    case PACKBITS_FILTER_PAETH:
+        for (; (x < end) && (x < bpp); ++x)
+        {
+            *outPtr++ = (uint8_t)(rowPtr[x] - upPtr[x]);
+        }
+        for (; x < end; ++x)
+        {
+            *outPtr++ = (uint8_t)(rowPtr[x] - paeth(rowPtr[x - bpp], upPtr[x], upPtr[x - bpp]));
+        }
+        break;
+    default:
+        memcpy(outPtr, rowPtr + x, end - x);
+        break;
+    }
+}
+
+// Unfilter the first count bytes of the row at rowPtr in place. upPtr is the
+// row above, already unfiltered, or NULL on the first row. With single byte
+// pixels the byte to the left is carried in a variable rather than read
+// back from the row just written.
+static inline void unfilter_row(const packbits_filter_t *filter, uint8_t *rowPtr, const uint8_t *upPtr,
+                                uint16_t count)
+{
+    uint16_t bpp = filter->bytesPerPixel;
+    uint8_t type = filter->type;
+    uint16_t x;
+    uint8_t left = 0;
+    uint8_t up;
+    uint8_t upLeft;
+    
+    if (upPtr == NULL)
+    {
+        if (type == PACKBITS_FILTER_UP) type = PACKBITS_FILTER_NONE;
+        if (type == PACKBITS_FILTER_PAETH) type = PACKBITS_FILTER_HORIZONTAL;
+    }
+    switch (type)
+    {
+    case PACKBITS_FILTER_HORIZONTAL:
+        if (bpp == 1)
+        {
+            for (x = 0; x < count; ++x)
+            {
+                left = (uint8_t)(rowPtr[x] + left);
+                rowPtr[x] = left;
+            }
+        }
+        else
+        {
+            for (x = bpp; x < count; ++x)
+            {
+                rowPtr[x] = (uint8_t)(rowPtr[x] + rowPtr[x - bpp]);
+            }
+        }
+        break;
+    case PACKBITS_FILTER_UP:
+        for (x = 0; x < count; ++x)
+        {
+            rowPtr[x] = (uint8_t)(rowPtr[x] + upPtr[x]);
+        }
+        break;
+    case PACKBITS_FILTER_PAETH:
+        for (x = 0; (x < count) && (x < bpp); ++x)
+        {
+            rowPtr[x] = (uint8_t)(rowPtr[x] + upPtr[x]);
+        }
+        if ((bpp == 1) && (count != 0))
+        {
+            left = rowPtr[0];
+            upLeft = upPtr[0];
+            for (; x < count; ++x)
+            {
+                up = upPtr[x];
+                left = (uint8_t)(rowPtr[x] + paeth(left, up, upLeft));
+                rowPtr[x] = left;
+                upLeft = up;
+            }
+        }
+        else
+        {
+            for (; x < count; ++x)
+            {
+                rowPtr[x] = (uint8_t)(rowPtr[x] + paeth(rowPtr[x - bpp], upPtr[x], upPtr[x - bpp]));
+            }
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+// Filter count bytes of srcPtr starting at pos, which is in column x of its
+// row, into outPtr. The work is split at row ends so that the row loops need
+// no tests of their own. Returns the column following the chunk.
+static uint16_t filter_chunk(const packbits_filter_t *filter, const uint8_t *srcPtr, uint8_t *outPtr,
+                             uint16_t pos, uint16_t count, uint16_t x)
+{
+    uint16_t rowLength = filter->rowLength;
+    uint16_t rowStart;              // Position of the start of the current row
+    uint16_t n;
+    
+    while (count != 0)
+    {
+        n = rowLength - x;
+        if (n > count)
+        {
+            n = count;
+        }
+        rowStart = pos - x;
+        filter_row(filter, srcPtr + rowStart, (rowStart >= rowLength) ? srcPtr + rowStart - rowLength : NULL,
+                   outPtr, x, x + n);
+        outPtr += n;
+        pos += n;
+        count -= n;
+        x += n;
+        if (x == rowLength) x = 0;
+    }
+    return x;
+}
+
+/*----------------------------------------------------------------------------
+packbits_filtered filters the source buffer and compresses it to the
+destination buffer. The source is not changed. Filtered bytes are only held
+in a small buffer on the stack, and the last block of each chunk is held
+back and packed again with the next chunk, so the output is the same as
+packing the whole filtered buffer with packbits. If the destination buffer
+is not large enough, the function returns 0 and the destination buffer
+content is incomplete.
+
+The destination size needed for unconditional compression is the same as
+for packbits.
+
+Return value is the size of destination buffer actually used.
+----------------------------------------------------------------------------*/
+uint16_t packbits_filtered(const uint8_t *srcPtr, uint8_t *destPtr, uint16_t srcCount, uint16_t destLimit,
+                           const packbits_filter_t *filter)
+{
+    packbits_filter_t resolved = filter_resolve(filter);
+    uint8_t chunk[MAX_DIFF + FILTER_CHUNK];    // Bytes held back, then the next filtered chunk
+    uint16_t carryCount = 0;        // Bytes held back from the previous chunk
+    uint16_t pendingCount;          // Bytes held back from this chunk
+    uint16_t destCount = 0;         // Destination buffer used
+    uint16_t packCount;
+    uint16_t pos;
+    uint16_t count;
+    uint16_t x = 0;                 // Column of pos within its row
+    
+    for (pos = 0; pos < srcCount; pos += count)
+    {
+        count = srcCount - pos;
+        if (count > FILTER_CHUNK)
+        {
+            count = FILTER_CHUNK;
+        }
+        x = filter_chunk(&resolved, srcPtr, chunk + carryCount, pos, count, x);
+        if (pos + count == srcCount)
+        {
+            packCount = pack_core(chunk, destPtr + destCount, carryCount + count, destLimit - destCount,
+                                  MIN_REPT, 2, false, NULL);
+            if (packCount == 0) return 0;
+            pendingCount = 0;
+        }
+        else
+        {
+            pendingCount = 0;
+            packCount = pack_core(chunk, destPtr + destCount, carryCount + count, destLimit - destCount,
+                                  MIN_REPT, 2, false, &pendingCount);
+            if (pendingCount == 0) return 0;
+            memmove(chunk, chunk + carryCount + count - pendingCount, pendingCount);
+        }
+        destCount += packCount;
+        carryCount = pendingCount;
+    }
+    return destCount;
+}
+
+/*----------------------------------------------------------------------------
+unpackbits_filtered decompresses data packed by packbits_filtered with the
+same filter. The data is unpacked by unpackbits and then unfiltered in
+place in a single pass. Unpacking stops when either the source runs out or
+the destination is full. A source size of 0 is treated as it is by
+unpackbits.
+
+Return value is the unpacked size, or the number of source bytes used if
+srcCount is 0.
+----------------------------------------------------------------------------*/
+uint16_t unpackbits_filtered(const uint8_t *srcPtr, uint8_t *destPtr, uint16_t srcCount, uint16_t destLimit,
+                             const packbits_filter_t *filter)
+{
+    packbits_filter_t resolved = filter_resolve(filter);
+    uint16_t result;                // Value returned by unpackbits
+    uint16_t count;                 // Bytes unpacked
+    uint16_t rowStart = 0;          // Position of the start of the current row
+    uint16_t n;
+    
+    result = unpackbits(srcPtr, destPtr, srcCount, destLimit);
+    count = result;
+    if (srcCount == 0)
+    {
+        // Unpacking only stops short of the destination if all of the
+        // 0xffff bytes allowed were used, so only then unpack again to count
+        count = (result < 0xffff) ? destLimit : unpackbits(srcPtr, destPtr, 0xffff, destLimit);
+    }
+    while (rowStart != count)
+    {
+        n = count - rowStart;
+        if (n > resolved.rowLength)
+        {
+            n = resolved.rowLength;
+        }
+        unfilter_row(&resolved, destPtr + rowStart, rowStart ? destPtr + rowStart - resolved.rowLength : NULL, n);
+        rowStart += n;
+    }
+    return result;
+}
+
+/*----------------------------------------------------------------------------
+Bit plane packing.
+
+With 1, 2 or 4 bits per pixel, several pixels share each byte, so a byte only
+repeats when the whole group of pixels repeats. Splitting the image into bit
+planes, each holding one bit of every pixel, gives much longer runs. Plane 0
+holds the lowest bit of each pixel and the planes are stored one after the
+other, each srcCount / bitsPerPixel bytes long. Pixels are taken from the
+most significant end of each byte first.
+----------------------------------------------------------------------------*/
+
+// Gather bit k of every pixel in a word of bitsPerPixel bytes, for k = 0.
+static uint8_t plane_gather(uint32_t word, uint8_t bitsPerPixel)
+{
+    if (bitsPerPixel == 2)
+    {
+        word &= 0x5555;
+        word = (word | (word >> 1)) & 0x3333;
+        word = (word | (word >> 2)) & 0x0f0f;
+        word = (word | (word >> 4)) & 0x00ff;
+    }
+    else
+    {
+        word &= 0x11111111;
+        word = (word | (word >> 3)) & 0x03030303;
+        word = (word | (word >> 6)) & 0x000f000f;
+        word = (word | (word >> 12)) & 0x000000ff;
+    }
+    return (uint8_t)word;
+}
+
+// Spread a plane byte back to bit 0 of every pixel in a word.
+static uint32_t plane_scatter(uint8_t bits, uint8_t bitsPerPixel)
+{
+    uint32_t word = bits;
+    
+    if (bitsPerPixel == 2)
+    {
+        word = (word | (word << 4)) & 0x0f0f;
+        word = (word | (word << 2)) & 0x3333;
+        word = (word | (word << 1)) & 0x5555;
+    }
+    else
+    {
+        word = (word | (word << 12)) & 0x000f000f;
+        word = (word | (word << 6)) & 0x03030303;
+        word = (word | (word << 3)) & 0x11111111;
+    }
+    return word;
+}
+
+/*----------------------------------------------------------------------------
+packbits_planes splits the source buffer of 1, 2 or 4 bit pixels into bit
+planes in the work buffer, which must hold srcCount bytes, and compresses
+them to the destination buffer. srcCount must be a multiple of bitsPerPixel.
+With 1 bit per pixel the data is packed as it is.
+
+The destination size needed for unconditional compression is the same as
+for packbits.
+
+Return value is the size of destination buffer actually used, or 0 if the
+destination buffer is too small or the parameters are not valid.
+----------------------------------------------------------------------------*/
+uint16_t packbits_planes(const uint8_t *srcPtr, uint8_t *destPtr, uint16_t srcCount, uint16_t destLimit,
+                         uint8_t bitsPerPixel, uint8_t *workPtr)
+{
+    uint16_t planeSize;             // Bytes in each plane
+    uint16_t pos;
+    uint32_t word;
+    uint8_t plane;
+    uint8_t i;
+    
+    if (bitsPerPixel == 1) return packbits(srcPtr, destPtr, srcCount, destLimit);
+    if (((bitsPerPixel != 2) && (bitsPerPixel != 4)) || (srcCount % bitsPerPixel)) return 0;
+    
+    planeSize = srcCount / bitsPerPixel;
+    for (pos = 0; pos < planeSize; ++pos)
+    {
+        word = 0;
+        for (i = 0; i < bitsPerPixel; ++i)
+        {
+            word = (word << 8) | *srcPtr++;
+        }
+        for (plane = 0; plane < bitsPerPixel; ++plane)
+        {
+            workPtr[plane * planeSize + pos] = plane_gather(word >> plane, bitsPerPixel);
+        }
+    }
+    return packbits(workPtr, destPtr, srcCount, destLimit);
+}
+
+/*----------------------------------------------------------------------------
+unpackbits_planes decompresses data packed by packbits_planes with the same
+number of bits per pixel. The planes are unpacked to the work buffer, which
+must hold destLimit bytes, and merged into the destination buffer. All the
+planes are needed to rebuild any pixel, so the whole image must fit within
+destLimit.
+
+Return value is the unpacked size, or 0 if the unpacked data is not a whole
+number of pixel groups.
+----------------------------------------------------------------------------*/
+uint16_t unpackbits_planes(const uint8_t *srcPtr, uint8_t *destPtr, uint16_t srcCount, uint16_t destLimit,
+                           uint8_t bitsPerPixel, uint8_t *workPtr)
+{
+    uint16_t destCount;             // Bytes unpacked
+    uint16_t planeSize;             // Bytes in each plane
+    uint16_t pos;
+    uint32_t word;
+    uint8_t plane;
+    uint8_t i;
+    
+    if (bitsPerPixel == 1) return unpackbits(srcPtr, destPtr, srcCount, destLimit);
+    if ((bitsPerPixel != 2) && (bitsPerPixel != 4)) return 0;
+    
+    destCount = unpackbits(srcPtr, workPtr, srcCount, destLimit);
+    if (destCount % bitsPerPixel) return 0;
+    
+    planeSize = destCount / bitsPerPixel;
+    for (pos = 0; pos < planeSize; ++pos)
+    {
+        word = 0;
+        for (plane = 0; plane < bitsPerPixel; ++plane)
+        {
+            word |= plane_scatter(workPtr[plane * planeSize + pos], bitsPerPixel) << plane;
+        }
+        for (i = bitsPerPixel; i > 0; --i)
+        {
+            *destPtr++ = (uint8_t)(word >> (8 * (i - 1)));
+        }
+    }
+    return destCount;
+}
+
+/*----------------------------------------------------------------------------
+Unpacking to a surface.
+
+The packed image is a sequence of rows of srcWidth bytes, drawn with its top
+left corner at x, y on a surface whose rows are pitch bytes apart. Only the
+part inside both the clip rectangle and the surface is written. Bytes to the
+left and right of it, and rows above it, are skipped in the packed data
+without being stored, and unpacking stops after the last visible row.
+----------------------------------------------------------------------------*/
+
+// Visible area of an image on a surface, in surface coordinates
+typedef struct
+{
+    int32_t left;
+    int32_t top;
+    int32_t right;                  // One past the last visible column
+    int32_t bottom;                 // One past the last visible row
+} blit_area_t;
+
+// Find the visible area, returning false if nothing is visible.
+static bool blit_area(blit_area_t *area, const packbits_surface_t *surface, uint16_t srcWidth,
+                      int16_t x, int16_t y, const packbits_rect_t *clip)
+{
+    area->left = (x > 0) ? x : 0;
+    area->top = (y > 0) ? y : 0;
+    area->right = (int32_t)x + srcWidth;
+    area->bottom = surface->height;
+    if (area->right > surface->width)
+    {
+        area->right = surface->width;
+    }
+    if (clip != NULL)
+    {
+        if (area->left < clip->x) area->left = clip->x;
+        if (area->top < clip->y) area->top = clip->y;
+        if (area->right > (int32_t)clip->x + clip->width) area->right = (int32_t)clip->x + clip->width;
+        if (area->bottom > (int32_t)clip->y + clip->height) area->bottom = (int32_t)clip->y + clip->height;
+    }
+    return (area->left < area->right) && (area->top < area->bottom);
+}
+
+// Unpack like unpackbits_resume, but leave destination bytes alone wherever
+// the unpacked value is the key. A negative key writes every byte.
+static uint16_t resume_keyed(packbits_state_t *state, uint8_t *destPtr, uint16_t destLimit, int16_t key)
+{
+    uint8_t count;                  // Bytes of the current run to output now
+    uint8_t i;
+    uint16_t destRemaining;         // Bytes still to be output
+    
+    if (key < 0) return unpackbits_resume(state, destPtr, destLimit);
+    destRemaining = destLimit;
+    while (destRemaining != 0)
+    {
+        if ((state->count == 0) && !resume_run(state)) break;
+        count = state->count;
+        if (count > destRemaining)
+        {
+            count = (uint8_t)destRemaining;
+        }
+        if (state->repeat)
+        {
+            // Transparent runs cost nothing
+            if (state->srcPtr[-1] != key) memset(destPtr, state->srcPtr[-1], count);
+        }
+        else
+        {
+            for (i = 0; i < count; ++i)
+            {
+                if (state->srcPtr[i] != key) destPtr[i] = state->srcPtr[i];
+            }
+            state->srcPtr += count;
+            state->srcRemaining -= count;
+        }
+        destPtr += count;
+        state->count -= count;
+        state->destPos += count;
+        destRemaining -= count;
+    }
+    return destLimit - destRemaining;
+}
+
+// Unpack an image to the visible area of a surface, returning the rows written.
+static uint16_t blit(const uint8_t *srcPtr, uint16_t srcCount, uint16_t srcWidth,
+                     const packbits_surface_t *surface, int16_t x, int16_t y, const packbits_rect_t *clip,
+                     int16_t key)
+{
+    packbits_state_t state;
+    blit_area_t area;
+    uint16_t leftSkip;              // Image bytes left of the visible area
+    uint16_t rightSkip;             // Image bytes right of the visible area
+    uint16_t visible;               // Image bytes written per row
+    uint16_t rows = 0;              // Rows written
+    int32_t row;
+    
+    if ((srcWidth == 0) || !blit_area(&area, surface, srcWidth, x, y, clip)) return 0;
+    leftSkip = (uint16_t)(area.left - x);
+    visible = (uint16_t)(area.right - area.left);
+    rightSkip = srcWidth - leftSkip - visible;
+    
+    unpackbits_init(&state, srcPtr, srcCount);
+    for (row = y; row < area.top; ++row)
+    {
+        if (unpackbits_resume(&state, NULL, srcWidth) < srcWidth) return 0;
+    }
+    for (; row < area.bottom; ++row)
+    {
+        if (unpackbits_resume(&state, NULL, leftSkip) < leftSkip) break;
+        if (resume_keyed(&state, surface->ptr + (size_t)row * surface->pitch + area.left, visible, key) == 0) break;
+        ++rows;
+        if (unpackbits_resume(&state, NULL, rightSkip) < rightSkip) break;
+    }
+    return rows;
+}
+
+/*----------------------------------------------------------------------------
+unpackbits_blit decompresses an image of srcWidth bytes per row directly to
+the surface, placed with its top left corner at x, y, which may be negative.
+If clip is not NULL, only bytes inside the clip rectangle are written. The
+image ends when the packed data runs out.
+
+Return value is the number of rows written to the surface, including a last
+partial row if the packed data ends part way through it.
+----------------------------------------------------------------------------*/
+uint16_t unpackbits_blit(const uint8_t *srcPtr, uint16_t srcCount, uint16_t srcWidth,
+                         const packbits_surface_t *surface, int16_t x, int16_t y, const packbits_rect_t *clip)
+{
+    return blit(srcPtr, srcCount, srcWidth, surface, x, y, clip, -1);
+}
+
+/*----------------------------------------------------------------------------
+unpackbits_sprite is the same as unpackbits_blit, except that bytes equal to
+the transparent key are not written, leaving the surface showing through.
+Repeated runs of the key are skipped without touching the surface at all, so
+drawing a sprite needs no separate blending pass.
+
+Return value is the number of rows drawn.
+----------------------------------------------------------------------------*/
+uint16_t unpackbits_sprite(const uint8_t *srcPtr, uint16_t srcCount, uint16_t srcWidth,
+                           const packbits_surface_t *surface, int16_t x, int16_t y, const packbits_rect_t *clip,
+                           uint8_t key)
+{
+    return blit(srcPtr, srcCount, srcWidth, surface, x, y, clip, key);
+}
+
+/*----------------------------------------------------------------------------
+Palette expansion.
+
+Indexed colour images are often unpacked only to be looked up in a palette
+straight away. Doing the lookup as the data is unpacked avoids writing and
+reading the indexed image: each repeated run needs a single lookup followed
+by a fill, and literal runs are looked up as they are copied.
+----------------------------------------------------------------------------*/
+
+// Unpack through a palette of 16 bit or, if wide, 32 bit colours.
+static inline uint16_t unpack_lut(const uint8_t *srcPtr, void *destPtr, uint16_t srcCount, uint16_t destLimit,
+                                  const void *lutPtr, bool wide)
+{
+    uint8_t hdr;                    // Header byte indicating run length and type
+    uint8_t count;                  // Run length derived from header
+    uint8_t i;
+    uint16_t srcRemaining;          // Number of bytes of source left to unpack
+    uint16_t destRemaining;         // Pixels still available for unpacking into
+    uint16_t *dest16 = destPtr;
+    uint32_t *dest32 = destPtr;
+    const uint16_t *lut16 = lutPtr;
+    const uint32_t *lut32 = lutPtr;
+    uint32_t colour;
+    const int srcLimit = 0xffff;    // Used for unpacking a fixed destination size
+    
+    srcRemaining = srcCount ? srcCount : srcLimit;
+    destRemaining = destLimit;
+    while ((srcRemaining != 0) && (destRemaining != 0))
+    {
+        hdr = *srcPtr++;
+        --srcRemaining;
+        if (IS_DIFF(hdr))
+        {
+            count = DECODE_DIFF(hdr);
+            if (count > destRemaining) count = (uint8_t)destRemaining;
+            if (count > srcRemaining) count = (uint8_t)srcRemaining;
+            if (wide)
+            {
+                for (i = 0; i < count; ++i) dest32[i] = lut32[srcPtr[i]];
+                dest32 += count;
+            }
+            else
+            {
+                for (i = 0; i < count; ++i) dest16[i] = lut16[srcPtr[i]];
+                dest16 += count;
+            }
+            srcPtr += count;
+            srcRemaining -= count;
+            destRemaining -= count;
+        }
+        else if (IS_REPT(hdr))
+        {
+            count = DECODE_REPT(hdr);
+            if (count > destRemaining) count = (uint8_t)destRemaining;
+            if (srcRemaining == 0) break;
+            if (wide)
+            {
+                colour = lut32[*srcPtr];
+                for (i = 0; i < count; ++i) dest32[i] = colour;
+                dest32 += count;
+            }
+            else
+            {
+                colour = lut16[*srcPtr];
+                for (i = 0; i < count; ++i) dest16[i] = (uint16_t)colour;
+                dest16 += count;
+            }
+            srcPtr++;
+            srcRemaining--;
+            destRemaining -= count;
+        }
+    }
+    if (srcCount == 0)
+    {
+        return srcLimit - srcRemaining;     // Number of source bytes used
+    }
+    return destLimit - destRemaining;       // Number of pixels actually output
+}
+
+/*----------------------------------------------------------------------------
+unpackbits_lut16 decompresses a packed indexed colour image, writing the
+entry of the 256 entry palette for each index to the destination. destLimit
+is in pixels. Otherwise it behaves like unpackbits, including the special
+case of a source size of 0.
+
+Return value is the number of pixels output.
+----------------------------------------------------------------------------*/
+uint16_t unpackbits_lut16(const uint8_t *srcPtr, uint16_t *destPtr, uint16_t srcCount, uint16_t destLimit,
+                          const uint16_t *lutPtr)
+{
+    return unpack_lut(srcPtr, destPtr, srcCount, destLimit, lutPtr, false);
+}
+
+/*----------------------------------------------------------------------------
+unpackbits_lut32 is the same as unpackbits_lut16 but with 32 bit colours.
+----------------------------------------------------------------------------*/
+uint16_t unpackbits_lut32(const uint8_t *srcPtr, uint32_t *destPtr, uint16_t srcCount, uint16_t destLimit,
+                          const uint32_t *lutPtr)
+{
+    return unpack_lut(srcPtr, destPtr, srcCount, destLimit, lutPtr, true);
+}
+
+/*----------------------------------------------------------------------------
+Operations on packed data.
+
+These work run by run with packbits_span_next rather than unpacking, so a
+repeated run is dealt with in one step however long it is. The source size
+must be the actual packed size, and a size of 0 is an empty stream rather
+than the unlimited source it means to unpackbits.
+----------------------------------------------------------------------------*/
+
+// Set up a state for walking spans, where a source size of 0 means no data.
+static void spans_init(packbits_state_t *state, const uint8_t *srcPtr, uint16_t srcCount)
+{
+    unpackbits_init(state, srcPtr, srcCount);
+    state->srcRemaining = srcCount;
+}
+
+// Find the first of count bytes that is not value, returning count if none.
+static uint16_t scan_not(const uint8_t *ptr, uint16_t count, uint8_t value)
+{
+    uint16_t i;
+    
+    for (i = 0; (i < count) && (ptr[i] == value); ++i)
+    {
+    }
+    return i;
+}
+
+/*----------------------------------------------------------------------------
+packbits_count counts the bytes equal to value in the unpacked data.
+----------------------------------------------------------------------------*/
+uint16_t packbits_count(const uint8_t *srcPtr, uint16_t srcCount, uint8_t value)
+{
+    packbits_state_t state;
+    packbits_span_t span;
+    uint16_t total = 0;             // Matching bytes found so far
+    uint16_t i;
+    
+    spans_init(&state, srcPtr, srcCount);
+    while (packbits_span_next(&state, &span))
+    {
+        if (span.repeat)
+        {
+            if (*span.dataPtr == value) total += span.length;
+        }
+        else
+        {
+            for (i = 0; i < span.length; ++i)
+            {
+                total += (span.dataPtr[i] == value);
+            }
+        }
+    }
+    return total;
+}
+
+/*----------------------------------------------------------------------------
+packbits_find finds the first byte equal to value in the unpacked data.
+
+Return value is its position, or PACKBITS_NOT_FOUND.
+----------------------------------------------------------------------------*/
+uint16_t packbits_find(const uint8_t *srcPtr, uint16_t srcCount, uint8_t value)
+{
+    packbits_state_t state;
+    packbits_span_t span;
+    const uint8_t *foundPtr;
+    
+    spans_init(&state, srcPtr, srcCount);
+    while (packbits_span_next(&state, &span))
+    {
+        if (span.repeat)
+        {
+            if (*span.dataPtr == value) return span.offset;
+        }
+        else
+        {
+            foundPtr = memchr(span.dataPtr, value, span.length);
+            if (foundPtr != NULL) return span.offset + (uint16_t)(foundPtr - span.dataPtr);
+        }
+    }
+    return PACKBITS_NOT_FOUND;
+}
+
+/*----------------------------------------------------------------------------
+packbits_find_not finds the first byte not equal to value in the unpacked
+data, so with a value of 0 it finds the first non-zero byte.
+
+Return value is its position, or PACKBITS_NOT_FOUND.
+----------------------------------------------------------------------------*/
+uint16_t packbits_find_not(const uint8_t *srcPtr, uint16_t srcCount, uint8_t value)
+{
+    packbits_state_t state;
+    packbits_span_t span;
+    uint16_t pos;
+    
+    spans_init(&state, srcPtr, srcCount);
+    while (packbits_span_next(&state, &span))
+    {
+        if (span.repeat)
+        {
+            if (*span.dataPtr != value) return span.offset;
+        }
+        else
+        {
+            pos = scan_not(span.dataPtr, span.length, value);
+            if (pos < span.length) return span.offset + pos;
+        }
+    }
+    return PACKBITS_NOT_FOUND;
+}
+
+/*----------------------------------------------------------------------------
+packbits_equal compares the unpacked data of two packed streams, which need
+not have been packed the same way.
+
+Return value is true if the unpacked data is the same.
+----------------------------------------------------------------------------*/
+bool packbits_equal(const uint8_t *aPtr, uint16_t aCount, const uint8_t *bPtr, uint16_t bCount)
+{
+    packbits_state_t a;
+    packbits_state_t b;
+    packbits_span_t aSpan;
+    packbits_span_t bSpan;
+    uint16_t aUsed = 0;             // Bytes of aSpan already compared
+    uint16_t bUsed = 0;             // Bytes of bSpan already compared
+    uint16_t count;                 // Bytes that both spans cover
+    bool aMore;
+    bool bMore;
+    bool same;
+    
+    spans_init(&a, aPtr, aCount);
+    spans_init(&b, bPtr, bCount);
+    aSpan.length = 0;
+    bSpan.length = 0;
+    for (;;)
+    {
+        aMore = true;
+        if (aUsed == aSpan.length)
+        {
+            aMore = packbits_span_next(&a, &aSpan);
+            aUsed = 0;
+        }
+        bMore = true;
+        if (bUsed == bSpan.length)
+        {
+            bMore = packbits_span_next(&b, &bSpan);
+            bUsed = 0;
+        }
+        if (!aMore || !bMore) return aMore == bMore;
+        
+        count = aSpan.length - aUsed;
+        if (count > bSpan.length - bUsed)
+        {
+            count = bSpan.length - bUsed;
+        }
+        if (aSpan.repeat && bSpan.repeat)
+        {
+            same = (*aSpan.dataPtr == *bSpan.dataPtr);
+        }
+        else if (aSpan.repeat)
+        {
+            same = (scan_not(bSpan.dataPtr + bUsed, count, *aSpan.dataPtr) == count);
+        }
+        else if (bSpan.repeat)
+        {
+            same = (scan_not(aSpan.dataPtr + aUsed, count, *bSpan.dataPtr) == count);
+        }
+        else
+        {
+            same = (memcmp(aSpan.dataPtr + aUsed, bSpan.dataPtr + bUsed, count) == 0);
+        }
+        if (!same) return false;
+        aUsed += count;
+        bUsed += count;
+    }
+}
+
+// Combine two bytes with one of the PACKBITS_OP_ operations.
+static uint8_t bit_op(uint8_t op, uint8_t x, uint8_t y)
+{
+    switch (op)
+    {
+    case PACKBITS_OP_AND:
+        return x & y;
+    case PACKBITS_OP_OR:
+        return x | y;
+    default:
+        return x ^ y;
+    }
+}
+
+/*----------------------------------------------------------------------------
+packbits_bitop combines two packed streams a byte at a time with AND, OR or
+XOR and packs the result, which is the same as packbits would give for the
+combined unpacked data. It works run by run: two repeated runs combine into a
+repeated run without looking at the bytes, as does a literal run against a
+repeated 0 for AND or 0xff for OR. Only other literal bytes are combined one
+by one. The result is as long as the shorter of the two unpacked streams,
+and a source size of 0 is an empty stream.
+
+If the destination buffer is not large enough, the function returns 0 and
+the destination buffer content is incomplete.
+
+Return value is the size of destination buffer actually used.
+----------------------------------------------------------------------------*/
+uint16_t packbits_bitop(const uint8_t *aPtr, uint16_t aCount, const uint8_t *bPtr, uint16_t bCount,
+                        uint8_t *destPtr, uint16_t destLimit, uint8_t op)
+{
+    packbits_encoder_t enc;
+    packbits_iovec_t destVec = { destPtr, destLimit };
+    iov_cursor_t dest;
+    packbits_state_t a;
+    packbits_state_t b;
+    packbits_span_t aSpan;
+    packbits_span_t bSpan;
+    const packbits_span_t *literal; // The literal span when only one is literal
+    const uint8_t *litPtr;          // Next literal byte to combine
+    uint16_t aUsed = 0;             // Bytes of aSpan already combined
+    uint16_t bUsed = 0;             // Bytes of bSpan already combined
+    uint16_t count;                 // Bytes that both spans cover
+    uint16_t i;
+    uint8_t fixed;                  // The repeated value when only one is repeated
+    uint8_t x;
+    uint8_t y;
+    
+    packbits_encoder_init(&enc);
+    cursor_init(&dest, &destVec, 1);
+    spans_init(&a, aPtr, aCount);
+    spans_init(&b, bPtr, bCount);
+    aSpan.length = 0;
+    bSpan.length = 0;
+    while (!dest.overflow)
+    {
+        if (aUsed == aSpan.length)
+        {
+            if (!packbits_span_next(&a, &aSpan)) break;
+            aUsed = 0;
+        }
+        if (bUsed == bSpan.length)
+        {
+            if (!packbits_span_next(&b, &bSpan)) break;
+            bUsed = 0;
+        }
+        count = aSpan.length - aUsed;
+        if (count > bSpan.length - bUsed)
+        {
+            count = bSpan.length - bUsed;
+        }
+        
+        if (aSpan.repeat && bSpan.repeat)
+        {
+            encode_run(&enc, bit_op(op, *aSpan.dataPtr, *bSpan.dataPtr), count, &dest);
+        }
+        else if (aSpan.repeat || bSpan.repeat)
+        {
+            fixed = aSpan.repeat ? *aSpan.dataPtr : *bSpan.dataPtr;
+            literal = aSpan.repeat ? &bSpan : &aSpan;
+            litPtr = literal->dataPtr + (aSpan.repeat ? bUsed : aUsed);
+            if (((op == PACKBITS_OP_AND) && (fixed == 0x00)) || ((op == PACKBITS_OP_OR) && (fixed == 0xff)))
+            {
+                encode_run(&enc, fixed, count, &dest);
+            }
+            else
+            {
+                for (i = 0; i < count; ++i)
+                {
+                    encode_byte(&enc, bit_op(op, litPtr[i], fixed), &dest);
+                }
+            }
+        }
+        else
+        {
+            for (i = 0; i < count; ++i)
+            {
+                x = aSpan.dataPtr[aUsed + i];
+                y = bSpan.dataPtr[bUsed + i];
+                encode_byte(&enc, bit_op(op, x, y), &dest);
+            }
+        }
+        aUsed += count;
+        bUsed += count;
+    }
+    encode_flush(&enc, &dest);
+    if (dest.overflow) return 0;
+    return destLimit - dest.space;
+}
+
+/*----------------------------------------------------------------------------
+packbits_normalise repacks a stream from any PackBits encoder, which may use
+two byte runs, needlessly split runs or no operation headers, into the same
+output packbits would give for the unpacked data. Repeated runs are passed
+to the encoder whole, so only literal bytes are looked at one by one and the
+data is never unpacked. The source and destination must not overlap. A
+source size of 0 is an empty stream.
+
+If the destination buffer is not large enough, the function returns 0 and
+the destination buffer content is incomplete.
+
+Return value is the size of destination buffer actually used.
+----------------------------------------------------------------------------*/
+uint16_t packbits_normalise(const uint8_t *srcPtr, uint16_t srcCount, uint8_t *destPtr, uint16_t destLimit)
+{
+    packbits_encoder_t enc;
+    packbits_iovec_t destVec = { destPtr, destLimit };
+    iov_cursor_t dest;
+    packbits_state_t state;
+    packbits_span_t span;
+    uint16_t i;
+    
+    packbits_encoder_init(&enc);
+    cursor_init(&dest, &destVec, 1);
+    spans_init(&state, srcPtr, srcCount);
+    while (!dest.overflow && packbits_span_next(&state, &span))
+    {
+        if (span.repeat)
+        {
+            encode_run(&enc, *span.dataPtr, span.length, &dest);
+        }
+        else
+        {
+            for (i = 0; i < span.length; ++i)
+            {
+                encode_byte(&enc, span.dataPtr[i], &dest);
+            }
+        }
+    }
+    encode_flush(&enc, &dest);
+    if (dest.overflow) return 0;
+    return destLimit - dest.space;
+}
@@ -5,10 +5,321 @@ packbits.h  -  run length encoding and decoding using MacPaint / TIFF format.
 #ifndef _PACKBITS_H_
 #define _PACKBITS_H_
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
+// Tuning for packbits_opt
+typedef struct
+{
+    uint8_t minRun;                 // Shortest run split out of a literal block
+    uint8_t headerCost;             // Extra bytes each header is charged, to favour unpacking speed
+    uint8_t align;                  // Alignment of packed rows, padded with no operation headers
+    uint16_t rowLength;             // Source bytes per row, or 0 to pack as one row
+} packbits_options_t;
+
+// Flags for packbits_frame
+#define PACKBITS_FRAME_CHECKSUM     0x01    // Record unpacked length and CRC-32C of each block
+
+// Prediction filters for packbits_filtered
+#define PACKBITS_FILTER_NONE        0       // Bytes are packed unchanged
+#define PACKBITS_FILTER_DELTA       1       // Difference from the previous byte
+#define PACKBITS_FILTER_HORIZONTAL  2       // Difference from the pixel to the left (TIFF predictor 2)
+#define PACKBITS_FILTER_UP          3       // Difference from the row above (PNG Up)
+#define PACKBITS_FILTER_PAETH       4       // Difference from the PNG Paeth predictor
+
+// Filter settings for packbits_filtered and unpackbits_filtered
+typedef struct
+{
+    uint8_t type;                   // One of PACKBITS_FILTER_...
+    uint8_t bytesPerPixel;          // Distance to the pixel to the left, 0 is treated as 1
+    uint16_t rowLength;             // Bytes per row, or 0 for a single row
+} packbits_filter_t;
+
+// A run of a packed stream, from packbits_span_next
+typedef struct
+{
+    uint16_t offset;                // Position of the run in the unpacked data
+    uint16_t length;                // Unpacked length of the run
+    bool repeat;                    // True for a repeated byte, false for literal bytes
+    const uint8_t *dataPtr;         // Literal bytes, or the repeated byte, in the packed data
+} packbits_span_t;
+
+// Returned by packbits_find and packbits_find_not when there is no match
+#define PACKBITS_NOT_FOUND          0xffff
+
+// Operations for packbits_bitop
+#define PACKBITS_OP_AND             0
+#define PACKBITS_OP_OR              1
+#define PACKBITS_OP_XOR             2
+
+// Destination surface for unpackbits_blit and unpackbits_sprite
+typedef struct
+{
+    uint8_t *ptr;                   // First byte of the top row
+    size_t pitch;                   // Bytes from the start of one row to the next
+    uint16_t width;                 // Bytes per row
+    uint16_t height;                // Rows
+} packbits_surface_t;
+
+// Clip rectangle, in surface bytes and rows
+typedef struct
+{
+    int16_t x;
+    int16_t y;
+    uint16_t width;
+    uint16_t height;
+} packbits_rect_t;
+
+// Space needed before the source data when packing in place
+#define PACKBITS_INPLACE_MARGIN(n)  (((n) + 127) / 128)
+
+// State for resumable unpacking
+typedef struct
+{
+    const uint8_t *srcPtr;          // Next source byte to be read
+    uint16_t srcRemaining;          // Number of bytes of source not yet read
+    uint16_t destPos;               // Output position of the next byte produced
+    uint8_t count;                  // Bytes of the current run still to output
+    bool repeat;                    // Current run is repeated rather than literal
+} packbits_state_t;
+
+// One block held by the unpacked block cache
+typedef struct
+{
+    const uint8_t *streamPtr;       // Packed stream the block belongs to, NULL if unused
+    uint16_t block;                 // Block index within the unpacked data
+    uint16_t length;                // Number of valid bytes in the block
+    uint8_t *dataPtr;               // Unpacked block content
+    packbits_state_t next;          // Unpacker state at the end of the block
+} packbits_cache_entry_t;
+
+// Least recently used cache of unpacked blocks
+typedef struct
+{
+    packbits_cache_entry_t *entries;    // Most recently used first
+    uint16_t numEntries;            // Number of blocks the cache can hold
+    uint16_t blockSize;             // Unpacked size of each block
+} packbits_cache_t;
+
+// State for streaming packing
+typedef struct
+{
+    uint8_t pending[128 + 1];       // Bytes looked at but not yet output
+    uint16_t bytesPending;          // Number of bytes in pending
+    uint16_t runStart;              // Distance into pending bytes that a run starts
+    uint8_t lastByte;               // Previous byte
+    bool inRun;                     // Pending bytes are a run of lastByte
+} packbits_encoder_t;
+
+// State for streaming unpacking, with packed data supplied in pieces
+typedef struct
+{
+    uint8_t count;                  // Bytes of the current run still to be output
+    uint8_t value;                  // Repeated byte, once it has been read
+    bool repeat;                    // Current run is a repeated byte
+    bool needValue;                 // Repeat header read but not its byte
+} packbits_decoder_t;
+
+// One segment of a scatter/gather buffer
+typedef struct
+{
+    uint8_t *ptr;                   // Start of segment
+    uint16_t len;                   // Size of segment in bytes
+} packbits_iovec_t;
+
+// Number of run length histogram bins: 1, 2, 3-4, 5-8, ... 65-128
+#define PACKBITS_HIST_BINS  8
+
+// Counters filled by packbits and unpackbits when PACKBITS_STATS is defined
+typedef struct
+{
+    uint32_t reptHeaders;           // Repeated runs
+    uint32_t diffHeaders;           // Literal blocks
+    uint32_t noopHeaders;           // No operation headers skipped
+    uint32_t reptBytes;             // Unpacked bytes in repeated runs
+    uint32_t diffBytes;             // Bytes in literal blocks
+    uint32_t reptHist[PACKBITS_HIST_BINS];  // Repeated run lengths
+    uint32_t diffHist[PACKBITS_HIST_BINS];  // Literal block lengths
+    uint32_t maxReptSplits;         // Runs split because they reached 128 bytes
+    uint32_t maxDiffSplits;         // Literal blocks split because they reached 128 bytes
+    uint32_t packOverflow;          // packbits gave up because the destination was full
+    uint32_t unpackDestFull;        // unpackbits stopped because the destination was full
+    uint32_t unpackSrcEnd;          // unpackbits stopped because the source ran out
+    uint32_t unpackTruncated;       // Runs cut short by the end of source or destination
+} packbits_stats_t;
+
+// Run structure of packed data gathered by packbits_analyse
+typedef struct
+{
+    uint32_t packedBytes;           // Size of packed data
+    uint32_t unpackedBytes;         // Size of unpacked data
+    uint32_t reptHeaders;           // Repeated runs
+    uint32_t diffHeaders;           // Literal blocks
+    uint32_t noopHeaders;           // No operation headers
+    uint32_t reptBytes;             // Unpacked bytes in repeated runs
+    uint32_t diffBytes;             // Bytes in literal blocks
+    uint32_t reptHist[PACKBITS_HIST_BINS];  // Repeated run lengths
+    uint32_t diffHist[PACKBITS_HIST_BINS];  // Literal block lengths
+    uint16_t packedPercent;         // Packed size as a percentage of unpacked size
+    uint16_t diffPercent;           // Percentage of unpacked bytes which are literal
+    uint16_t headersPerKB;          // Headers to decode per 1024 unpacked bytes
+} packbits_analysis_t;
+
+// Part of a packed stream which can be unpacked independently
+typedef struct
+{
+    uint16_t srcOffset;             // Start of the part in the packed stream
+    uint16_t srcCount;              // Packed size of the part
+    uint16_t destOffset;            // Start of the part in the unpacked data
+    uint16_t destCount;             // Unpacked size of the part
+} packbits_range_t;
+
+// Memory needed by each pipeline slot: room for bytes held over from the
+// previous slot, the raw data and the largest packed output of both
+#define PACKBITS_PIPE_SLOT_SIZE(n)  (128 + 2 * (n) + ((n) + 127) / 128 + 2 * (1 + 128))
+
+// One buffer of the packing pipeline
+typedef struct
+{
+    uint8_t *rawPtr;                // Raw data read
+    uint8_t *packedPtr;             // Packed data to write
+    uint64_t rawOffset;             // Position of the raw data in the input
+    uint64_t packedOffset;          // Position of the packed data in the output
+    uint16_t rawCount;              // Bytes of raw data
+    uint16_t packedCount;           // Bytes of packed data
+    uint8_t state;                  // Stage the slot has reached
+} packbits_slot_t;
+
+// Callback to start reading into, or writing from, a pipeline slot.
+// A read may read up to the pipeline blockSize bytes into slot->rawPtr.
+// A write must write slot->packedCount bytes from slot->packedPtr.
+// The offsets allow positional I/O with several operations in flight.
+typedef void (*packbits_pipe_fn)(void *user, packbits_slot_t *slot);
+
+// Pipelined packer
+typedef struct
+{
+    packbits_slot_t *slots;         // Ring of buffers
+    uint16_t numSlots;              // Number of slots in the ring
+    uint16_t blockSize;             // Raw bytes per read
+    packbits_pipe_fn read;          // Starts a read
+    packbits_pipe_fn write;         // Starts a write
+    void *user;                     // Passed to the callbacks
+    uint16_t readSlot;              // Next slot to read into
+    uint16_t packSlot;              // Next slot to pack
+    uint16_t writeSlot;             // Next slot to write from
+    uint64_t rawOffset;             // Input position of the next read
+    uint64_t packedOffset;          // Output position of the next packed slot
+    bool endOfInput;                // Input has ended and the stream is complete
+    bool running;                   // Pipeline is being run
+    bool rerun;                     // A completion arrived while running
+    uint16_t carryCount;            // Bytes held over in front of the next slot
+} packbits_pipe_t;
+
+// Allocation-free context, placed in caller supplied memory
+typedef struct packbits_ctx packbits_ctx_t;
+
 uint16_t packbits(const uint8_t *srcPtr, uint8_t *destPtr, uint16_t srcCount, uint16_t destLimit);
 uint16_t unpackbits(const uint8_t *srcPtr, uint8_t *destPtr, uint16_t srcCount, uint16_t destLimit);
+uint16_t packbits_opt(const uint8_t *srcPtr, uint8_t *destPtr, uint16_t srcCount, uint16_t destLimit,
+                      const packbits_options_t *options);
 uint16_t unpackbits_window(const uint8_t *srcPtr, uint8_t *destPtr, uint16_t srcCount, uint16_t destStartByte, uint16_t destLimit);
+uint16_t unpackbits_table(const uint8_t *srcPtr, uint8_t *destPtr, uint16_t srcCount, uint16_t destLimit);
+
+#ifdef PACKBITS_STATS
+void packbits_stats_attach(packbits_stats_t *statsPtr);
+#endif
+
+void unpackbits_init(packbits_state_t *state, const uint8_t *srcPtr, uint16_t srcCount);
+uint16_t unpackbits_resume(packbits_state_t *state, uint8_t *destPtr, uint16_t destLimit);
+
+bool packbits_span_next(packbits_state_t *state, packbits_span_t *span);
+
+uint16_t packbits_cache_init(packbits_cache_t *cache, packbits_cache_entry_t *entries, uint16_t maxEntries,
+                             uint8_t *dataPtr, uint16_t dataSize, uint16_t blockSize);
+void packbits_cache_invalidate(packbits_cache_t *cache, const uint8_t *streamPtr);
+uint16_t unpackbits_window_cached(packbits_cache_t *cache, const uint8_t *srcPtr, uint8_t *destPtr,
+                                  uint16_t srcCount, uint16_t destStartByte, uint16_t destLimit);
+
+void packbits_encoder_init(packbits_encoder_t *enc);
+uint16_t packbits_encode(packbits_encoder_t *enc, const uint8_t *srcPtr, uint16_t srcCount,
+                         uint8_t *destPtr, uint16_t destLimit, uint16_t *srcUsed);
+uint16_t packbits_encode_end(packbits_encoder_t *enc, uint8_t *destPtr, uint16_t destLimit);
+uint16_t packbits_encode_run(packbits_encoder_t *enc, uint8_t value, uint16_t count,
+                             uint8_t *destPtr, uint16_t destLimit, uint16_t *srcUsed);
+
+void packbits_decoder_init(packbits_decoder_t *dec);
+uint16_t packbits_decode(packbits_decoder_t *dec, const uint8_t *srcPtr, uint16_t srcCount,
+                         uint8_t *destPtr, uint16_t destLimit, uint16_t *srcUsed);
+bool packbits_decode_complete(const packbits_decoder_t *dec);
+
+uint16_t packbits_iov(const packbits_iovec_t *srcVec, uint16_t srcSegs, const packbits_iovec_t *destVec, uint16_t destSegs);
+uint16_t unpackbits_iov(const packbits_iovec_t *srcVec, uint16_t srcSegs, const packbits_iovec_t *destVec, uint16_t destSegs);
+
+size_t packbits_ctx_size(uint16_t indexEntries);
+packbits_ctx_t *packbits_ctx_init(void *memPtr, size_t memSize, uint16_t indexEntries);
+packbits_encoder_t *packbits_ctx_encoder(packbits_ctx_t *ctx);
+packbits_state_t *packbits_ctx_decoder(packbits_ctx_t *ctx);
+uint16_t packbits_ctx_index(packbits_ctx_t *ctx, const uint8_t *srcPtr, uint16_t srcCount, uint16_t indexInterval);
+uint16_t unpackbits_ctx_window(packbits_ctx_t *ctx, uint8_t *destPtr, uint16_t destStartByte, uint16_t destLimit);
+
+uint16_t unpackbits_inplace_margin(const uint8_t *srcPtr, uint16_t srcCount);
+uint16_t unpackbits_inplace(uint8_t *bufPtr, uint16_t srcCount, uint16_t bufSize);
+
+uint16_t packbits_inplace(uint8_t *bufPtr, uint16_t srcCount);
+
+void packbits_analysis_init(packbits_analysis_t *analysis);
+void packbits_analyse(packbits_analysis_t *analysis, const uint8_t *srcPtr, uint16_t srcCount);
+void packbits_analyse_raw(packbits_analysis_t *analysis, const uint8_t *srcPtr, uint16_t srcCount);
+
+uint16_t packbits_frame(const uint8_t *srcPtr, uint8_t *destPtr, uint16_t srcCount, uint16_t destLimit,
+                        uint16_t blockSize, uint8_t minGainPercent, uint8_t flags);
+uint16_t unpackbits_frame(const uint8_t *srcPtr, uint8_t *destPtr, uint16_t srcCount, uint16_t destLimit);
+uint32_t packbits_crc32c(uint32_t crc, const uint8_t *srcPtr, uint16_t count);
+
+uint16_t unpackbits_plan(const uint8_t *srcPtr, uint16_t srcCount, packbits_range_t *ranges, uint16_t maxRanges);
+uint16_t unpackbits_range(const uint8_t *srcPtr, uint8_t *destPtr, const packbits_range_t *range);
+
+uint16_t packbits_join(uint8_t *destPtr, uint16_t destCount, const uint8_t *srcPtr, uint16_t srcCount, uint16_t destLimit);
+
+bool packbits_pipe_init(packbits_pipe_t *pipe, packbits_slot_t *slots, uint16_t numSlots,
+                        uint8_t *memPtr, uint16_t blockSize,
+                        packbits_pipe_fn read, packbits_pipe_fn write, void *user);
+void packbits_pipe_run(packbits_pipe_t *pipe);
+void packbits_pipe_read_done(packbits_pipe_t *pipe, packbits_slot_t *slot, uint16_t count);
+void packbits_pipe_write_done(packbits_pipe_t *pipe, packbits_slot_t *slot);
+bool packbits_pipe_finished(const packbits_pipe_t *pipe);
+
+uint16_t packbits_filtered(const uint8_t *srcPtr, uint8_t *destPtr, uint16_t srcCount, uint16_t destLimit,
+                           const packbits_filter_t *filter);
+uint16_t unpackbits_filtered(const uint8_t *srcPtr, uint8_t *destPtr, uint16_t srcCount, uint16_t destLimit,
+                             const packbits_filter_t *filter);
+
+uint16_t packbits_planes(const uint8_t *srcPtr, uint8_t *destPtr, uint16_t srcCount, uint16_t destLimit,
+                         uint8_t bitsPerPixel, uint8_t *workPtr);
+uint16_t unpackbits_planes(const uint8_t *srcPtr, uint8_t *destPtr, uint16_t srcCount, uint16_t destLimit,
+                           uint8_t bitsPerPixel, uint8_t *workPtr);
+
+uint16_t unpackbits_blit(const uint8_t *srcPtr, uint16_t srcCount, uint16_t srcWidth,
+                         const packbits_surface_t *surface, int16_t x, int16_t y, const packbits_rect_t *clip);
+uint16_t unpackbits_sprite(const uint8_t *srcPtr, uint16_t srcCount, uint16_t srcWidth,
+                           const packbits_surface_t *surface, int16_t x, int16_t y, const packbits_rect_t *clip,
+                           uint8_t key);
+
+uint16_t unpackbits_lut16(const uint8_t *srcPtr, uint16_t *destPtr, uint16_t srcCount, uint16_t destLimit,
+                          const uint16_t *lutPtr);
+uint16_t unpackbits_lut32(const uint8_t *srcPtr, uint32_t *destPtr, uint16_t srcCount, uint16_t destLimit,
+                          const uint32_t *lutPtr);
+
+uint16_t packbits_count(const uint8_t *srcPtr, uint16_t srcCount, uint8_t value);
+uint16_t packbits_find(const uint8_t *srcPtr, uint16_t srcCount, uint8_t value);
+uint16_t packbits_find_not(const uint8_t *srcPtr, uint16_t srcCount, uint8_t value);
+bool packbits_equal(const uint8_t *aPtr, uint16_t aCount, const uint8_t *bPtr, uint16_t bCount);
+
+uint16_t packbits_bitop(const uint8_t *aPtr, uint16_t aCount, const uint8_t *bPtr, uint16_t bCount,
+                        uint8_t *destPtr, uint16_t destLimit, uint8_t op);
+
+uint16_t packbits_normalise(const uint8_t *srcPtr, uint16_t srcCount, uint8_t *destPtr, uint16_t destLimit);
 
 #endif
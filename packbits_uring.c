@@ -0,0 +1,536 @@
+/*****************************************************************************
+packbits_uring.c  -  file to file packing and unpacking using Linux io_uring.
+
+Reads and writes are queued with io_uring, several at a time, and the data is
+packed or unpacked as they complete. One core can then keep a fast drive busy
+instead of waiting for each read and write in turn. Packing uses the
+pipelined packer from packbits.c. Unpacking uses the streaming decoder, so
+packed blocks may be split across reads.
+
+The io_uring system calls are made directly, so liburing is not needed. The
+memory for the data buffers is supplied by the caller, as for the rest of the
+library. This file only builds on Linux and needs kernel 5.6 or later for
+IORING_OP_READ and IORING_OP_WRITE.
+
+Both functions use positional I/O, so the input must be a regular file or
+block device, read from offset 0, and the output is written from offset 0.
+They return 0 on success, or a negative errno value.
+******************************************************************************/
+
+#ifdef __linux__
+
+#define _GNU_SOURCE                 // For syscall and MAP_POPULATE
+#include <errno.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <linux/io_uring.h>
+#include "packbits.h"
+#include "packbits_uring.h"
+
+/*----------------------------------------------------------------------------
+Minimal io_uring.
+
+Only what the drivers need: queue a read or write, submit, wait for at least
+one completion and hand each completion to a handler. There are never more
+operations in flight than the ring has entries, so the submission queue
+cannot overflow.
+----------------------------------------------------------------------------*/
+
+typedef void (*uring_fn)(void *user, uint64_t userData, int32_t res);
+
+typedef struct
+{
+    int fd;                         // Ring file descriptor
+    unsigned *sqTail;               // Submission queue, shared with the kernel
+    unsigned *sqMask;
+    unsigned *sqArray;
+    struct io_uring_sqe *sqes;
+    unsigned *cqHead;               // Completion queue, shared with the kernel
+    unsigned *cqTail;
+    unsigned *cqMask;
+    struct io_uring_cqe *cqes;
+    void *sqMap;                    // Mappings to release
+    size_t sqMapSize;
+    void *cqMap;
+    size_t cqMapSize;
+    size_t sqesSize;
+    unsigned toSubmit;              // Queued but not yet submitted
+    unsigned inFlight;              // Queued but not yet completed
+} uring_t;
+
+static void uring_exit(uring_t *ring)
+{
+    if (ring->sqes != MAP_FAILED) munmap(ring->sqes, ring->sqesSize);
+    if ((ring->cqMap != MAP_FAILED) && (ring->cqMap != ring->sqMap)) munmap(ring->cqMap, ring->cqMapSize);
+    if (ring->sqMap != MAP_FAILED) munmap(ring->sqMap, ring->sqMapSize);
+    close(ring->fd);
+}
+
+static int uring_init(uring_t *ring, unsigned entries)
+{
+    struct io_uring_params params;
+    uint8_t *sq;
+    uint8_t *cq;
+    
+    memset(&params, 0, sizeof(params));
+    ring->fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (ring->fd < 0) return -errno;
+    
+    ring->sqMapSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cqMapSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        // Both rings share one mapping
+        if (ring->cqMapSize > ring->sqMapSize) ring->sqMapSize = ring->cqMapSize;
+        ring->cqMapSize = ring->sqMapSize;
+    }
+    ring->sqMap = mmap(NULL, ring->sqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       ring->fd, IORING_OFF_SQ_RING);
+    ring->cqMap = ring->sqMap;
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP) && (ring->sqMap != MAP_FAILED))
+    {
+        ring->cqMap = mmap(NULL, ring->cqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                           ring->fd, IORING_OFF_CQ_RING);
+    }
+    ring->sqes = MAP_FAILED;
+    if (ring->cqMap != MAP_FAILED)
+    {
+        ring->sqes = mmap(NULL, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          ring->fd, IORING_OFF_SQES);
+    }
+    if (ring->sqes == MAP_FAILED)
+    {
+        int err = -errno;
+    
+        uring_exit(ring);
+        return err;
+    }
+    
+    sq = ring->sqMap;
+    cq = ring->cqMap;
+    ring->sqTail = (unsigned *)(sq + params.sq_off.tail);
+    ring->sqMask = (unsigned *)(sq + params.sq_off.ring_mask);
+    ring->sqArray = (unsigned *)(sq + params.sq_off.array);
+    ring->cqHead = (unsigned *)(cq + params.cq_off.head);
+    ring->cqTail = (unsigned *)(cq + params.cq_off.tail);
+    ring->cqMask = (unsigned *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+    ring->toSubmit = 0;
+    ring->inFlight = 0;
+    return 0;
+}
+
+// Queue a positional read or write, to be submitted by uring_wait.
+static void uring_queue(uring_t *ring, uint8_t opcode, int fd, void *ptr, uint32_t len,
+                        uint64_t offset, uint64_t userData)
+{
+    unsigned tail = *ring->sqTail;
+    unsigned index = tail & *ring->sqMask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+    
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)ptr;
+    sqe->len = len;
+    sqe->off = offset;
+    sqe->user_data = userData;
+    ring->sqArray[index] = index;
+    __atomic_store_n(ring->sqTail, tail + 1, __ATOMIC_RELEASE);
+    ++ring->toSubmit;
+    ++ring->inFlight;
+}
+
+// Submit what is queued, wait for at least one completion and pass each
+// completion to the handler, which may queue more operations.
+static int uring_wait(uring_t *ring, uring_fn handler, void *user)
+{
+    struct io_uring_cqe *cqe;
+    unsigned head;
+    long ret;
+    
+    ret = syscall(__NR_io_uring_enter, ring->fd, ring->toSubmit, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+    if (ret < 0)
+    {
+        if (errno != EINTR) return -errno;
+    }
+    else
+    {
+        ring->toSubmit -= (unsigned)ret;
+    }
+    head = *ring->cqHead;
+    while (head != __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE))
+    {
+        cqe = &ring->cqes[head & *ring->cqMask];
+        --ring->inFlight;
+        handler(user, cqe->user_data, cqe->res);
+        ++head;
+        __atomic_store_n(ring->cqHead, head, __ATOMIC_RELEASE);
+    }
+    return 0;
+}
+
+/*----------------------------------------------------------------------------
+File packing.
+
+The pipeline callbacks queue a read or write for their slot. A read which
+comes back short before the end of the file, or a short write, is queued
+again for the rest, since the pipeline needs whole blocks.
+----------------------------------------------------------------------------*/
+
+typedef struct
+{
+    uring_t ring;
+    packbits_pipe_t pipe;
+    packbits_slot_t slots[PACKBITS_URING_MAX_SLOTS];
+    uint16_t done[PACKBITS_URING_MAX_SLOTS];    // Bytes transferred by each slot's operation
+    int inFd;
+    int outFd;
+    int error;                      // First error, after which nothing new is started
+} pack_job_t;
+
+// User data holds the slot number and whether the operation is a write.
+#define JOB_DATA(slot, write)   (2 * (uint64_t)(slot) + ((write) ? 1 : 0))
+#define JOB_SLOT(data)          ((uint16_t)((data) / 2))
+#define JOB_WRITE(data)         (((data) & 1) != 0)
+
+static void pack_read(void *user, packbits_slot_t *slot)
+{
+    pack_job_t *job = user;
+    uint16_t i = (uint16_t)(slot - job->slots);
+    
+    job->done[i] = 0;
+    if (job->error != 0) return;
+    uring_queue(&job->ring, IORING_OP_READ, job->inFd, slot->rawPtr, job->pipe.blockSize,
+                slot->rawOffset, JOB_DATA(i, false));
+}
+
+static void pack_write(void *user, packbits_slot_t *slot)
+{
+    pack_job_t *job = user;
+    uint16_t i = (uint16_t)(slot - job->slots);
+    
+    job->done[i] = 0;
+    if (job->error != 0) return;
+    uring_queue(&job->ring, IORING_OP_WRITE, job->outFd, slot->packedPtr, slot->packedCount,
+                slot->packedOffset, JOB_DATA(i, true));
+}
+
+static void pack_complete(void *user, uint64_t userData, int32_t res)
+{
+    pack_job_t *job = user;
+    uint16_t i = JOB_SLOT(userData);
+    packbits_slot_t *slot = &job->slots[i];
+    
+    if ((res < 0) || (job->error != 0))
+    {
+        if (job->error == 0) job->error = res;
+        return;
+    }
+    job->done[i] += (uint16_t)res;
+    if (JOB_WRITE(userData))
+    {
+        if (res == 0)
+        {
+            job->error = -EIO;
+        }
+        else if (job->done[i] < slot->packedCount)
+        {
+            uring_queue(&job->ring, IORING_OP_WRITE, job->outFd, slot->packedPtr + job->done[i],
+                        slot->packedCount - job->done[i], slot->packedOffset + job->done[i], userData);
+        }
+        else
+        {
+            packbits_pipe_write_done(&job->pipe, slot);
+        }
+    }
+    else
+    {
+        if ((res != 0) && (job->done[i] < job->pipe.blockSize))
+        {
+            uring_queue(&job->ring, IORING_OP_READ, job->inFd, slot->rawPtr + job->done[i],
+                        job->pipe.blockSize - job->done[i], slot->rawOffset + job->done[i], userData);
+        }
+        else
+        {
+            packbits_pipe_read_done(&job->pipe, slot, job->done[i]);
+        }
+    }
+}
+
+/*----------------------------------------------------------------------------
+packbits_uring_pack packs the whole of inFd to outFd as a single packed
+stream, identical to packing the file with packbits_encode. memPtr provides
+PACKBITS_PIPE_SLOT_SIZE(blockSize) bytes for each slot, and up to
+PACKBITS_URING_MAX_SLOTS slots are used. Each slot has one read or write in
+flight at a time.
+
+Return value is 0 on success or a negative errno value.
+----------------------------------------------------------------------------*/
+int packbits_uring_pack(int inFd, int outFd, uint8_t *memPtr, size_t memSize, uint16_t blockSize)
+{
+    pack_job_t job;
+    size_t numSlots;
+    int err;
+    
+    if (blockSize == 0) return -EINVAL;
+    numSlots = memSize / PACKBITS_PIPE_SLOT_SIZE(blockSize);
+    if (numSlots > PACKBITS_URING_MAX_SLOTS)
+    {
+        numSlots = PACKBITS_URING_MAX_SLOTS;
+    }
+    if (!packbits_pipe_init(&job.pipe, job.slots, (uint16_t)numSlots, memPtr, blockSize,
+                            pack_read, pack_write, &job))
+    {
+        return -EINVAL;
+    }
+    job.inFd = inFd;
+    job.outFd = outFd;
+    job.error = 0;
+    err = uring_init(&job.ring, (unsigned)numSlots);
+    if (err != 0) return err;
+    
+    packbits_pipe_run(&job.pipe);
+    while (((job.error == 0) && !packbits_pipe_finished(&job.pipe)) || (job.ring.inFlight != 0))
+    {
+        if (job.ring.inFlight == 0)
+        {
+            job.error = -EIO;       // Stalled with nothing to wait for
+            break;
+        }
+        err = uring_wait(&job.ring, pack_complete, &job);
+        if (err != 0)
+        {
+            job.error = err;
+            break;
+        }
+    }
+    uring_exit(&job.ring);
+    return job.error;
+}
+
+/*----------------------------------------------------------------------------
+File unpacking.
+
+Packed input is read into a ring of input buffers and decoded in order into
+a ring of output buffers. Each output buffer is written as soon as it is
+full, and decoding waits if the next output buffer is still being written.
+An input buffer is read again as soon as it has been decoded.
+----------------------------------------------------------------------------*/
+
+enum
+{
+    BUF_FREE,                       // Input: can be read into; output: can be filled
+    BUF_BUSY,                       // Read or write in progress
+    BUF_READY                       // Input: read complete, waiting to be decoded
+};
+
+typedef struct
+{
+    uint8_t *ptr;                   // Buffer of blockSize bytes
+    uint64_t offset;                // File position of the buffer
+    uint16_t count;                 // Bytes read, or bytes filled for output
+    uint16_t used;                  // Input bytes decoded, or output bytes written
+    uint8_t state;
+} unpack_buf_t;
+
+typedef struct
+{
+    uring_t ring;
+    packbits_decoder_t dec;
+    unpack_buf_t in[PACKBITS_URING_MAX_SLOTS];
+    unpack_buf_t out[PACKBITS_URING_MAX_SLOTS];
+    uint16_t numSlots;
+    uint16_t blockSize;
+    uint16_t readSlot;              // Next input buffer to read into
+    uint16_t decodeSlot;            // Next input buffer to decode
+    uint16_t fillSlot;              // Output buffer being filled
+    uint64_t inOffset;              // File position of the next read
+    uint64_t outOffset;             // File position of the next write
+    bool endOfInput;                // End of the packed input has been decoded
+    int inFd;
+    int outFd;
+    int error;                      // First error, after which nothing new is started
+} unpack_job_t;
+
+// Start writing the output buffer being filled and move on to the next.
+static void unpack_flush(unpack_job_t *job)
+{
+    unpack_buf_t *out = &job->out[job->fillSlot];
+    
+    out->state = BUF_BUSY;
+    out->offset = job->outOffset;
+    out->used = 0;
+    job->outOffset += out->count;
+    uring_queue(&job->ring, IORING_OP_WRITE, job->outFd, out->ptr, out->count, out->offset,
+                JOB_DATA(job->fillSlot, true));
+    job->fillSlot = (job->fillSlot + 1) % job->numSlots;
+}
+
+// Decode whatever input is ready, in order, and start reads into free buffers.
+static void unpack_run(unpack_job_t *job)
+{
+    unpack_buf_t *in;
+    unpack_buf_t *out;
+    uint16_t srcUsed;
+    
+    if (job->error != 0) return;
+    in = &job->in[job->decodeSlot];
+    while (!job->endOfInput && (in->state == BUF_READY))
+    {
+        out = &job->out[job->fillSlot];
+        if (out->state == BUF_BUSY) break;      // Wait for the write to finish
+        if (in->count == 0)
+        {
+            // End of the packed input
+            job->endOfInput = true;
+            if (!packbits_decode_complete(&job->dec))
+            {
+                job->error = -EINVAL;           // Truncated stream
+                return;
+            }
+            if (out->count != 0) unpack_flush(job);
+            break;
+        }
+        out->count += packbits_decode(&job->dec, in->ptr + in->used, in->count - in->used,
+                                      out->ptr + out->count, job->blockSize - out->count, &srcUsed);
+        in->used += srcUsed;
+        if (out->count == job->blockSize) unpack_flush(job);
+        if (in->used == in->count)
+        {
+            in->state = BUF_FREE;
+            job->decodeSlot = (job->decodeSlot + 1) % job->numSlots;
+            in = &job->in[job->decodeSlot];
+        }
+    }
+    
+    in = &job->in[job->readSlot];
+    while (!job->endOfInput && (in->state == BUF_FREE))
+    {
+        in->state = BUF_BUSY;
+        in->offset = job->inOffset;
+        in->count = 0;
+        in->used = 0;
+        job->inOffset += job->blockSize;
+        uring_queue(&job->ring, IORING_OP_READ, job->inFd, in->ptr, job->blockSize, in->offset,
+                    JOB_DATA(job->readSlot, false));
+        job->readSlot = (job->readSlot + 1) % job->numSlots;
+        in = &job->in[job->readSlot];
+    }
+}
+
+static void unpack_complete(void *user, uint64_t userData, int32_t res)
+{
+    unpack_job_t *job = user;
+    unpack_buf_t *buf;
+    
+    if ((res < 0) || (job->error != 0))
+    {
+        if (job->error == 0) job->error = res;
+        return;
+    }
+    if (JOB_WRITE(userData))
+    {
+        buf = &job->out[JOB_SLOT(userData)];
+        buf->used += (uint16_t)res;
+        if (res == 0)
+        {
+            job->error = -EIO;
+            return;
+        }
+        if (buf->used < buf->count)
+        {
+            uring_queue(&job->ring, IORING_OP_WRITE, job->outFd, buf->ptr + buf->used,
+                        buf->count - buf->used, buf->offset + buf->used, userData);
+            return;
+        }
+        buf->state = BUF_FREE;
+        buf->count = 0;
+    }
+    else
+    {
+        buf = &job->in[JOB_SLOT(userData)];
+        buf->count += (uint16_t)res;
+        if ((res != 0) && (buf->count < job->blockSize))
+        {
+            uring_queue(&job->ring, IORING_OP_READ, job->inFd, buf->ptr + buf->count,
+                        job->blockSize - buf->count, buf->offset + buf->count, userData);
+            return;
+        }
+        buf->state = BUF_READY;
+    }
+    unpack_run(job);
+}
+
+/*----------------------------------------------------------------------------
+packbits_uring_unpack unpacks a packed stream in inFd, such as one written by
+packbits_uring_pack, to outFd. memPtr provides
+PACKBITS_URING_UNPACK_SLOT_SIZE(blockSize) bytes for each slot, and up to
+PACKBITS_URING_MAX_SLOTS slots are used. Each slot has an input and an
+output buffer, each with at most one read or write in flight.
+
+Return value is 0 on success, -EINVAL if the packed stream is truncated, or
+another negative errno value.
+----------------------------------------------------------------------------*/
+int packbits_uring_unpack(int inFd, int outFd, uint8_t *memPtr, size_t memSize, uint16_t blockSize)
+{
+    unpack_job_t job;
+    size_t numSlots;
+    uint16_t i;
+    int err;
+    
+    if (blockSize == 0) return -EINVAL;
+    numSlots = memSize / PACKBITS_URING_UNPACK_SLOT_SIZE(blockSize);
+    if (numSlots > PACKBITS_URING_MAX_SLOTS)
+    {
+        numSlots = PACKBITS_URING_MAX_SLOTS;
+    }
+    if (numSlots == 0) return -EINVAL;
+    for (i = 0; i < numSlots; ++i)
+    {
+        job.in[i].ptr = memPtr;
+        job.in[i].state = BUF_FREE;
+        job.out[i].ptr = memPtr + blockSize;
+        job.out[i].count = 0;
+        job.out[i].state = BUF_FREE;
+        memPtr += PACKBITS_URING_UNPACK_SLOT_SIZE(blockSize);
+    }
+    packbits_decoder_init(&job.dec);
+    job.numSlots = (uint16_t)numSlots;
+    job.blockSize = blockSize;
+    job.readSlot = 0;
+    job.decodeSlot = 0;
+    job.fillSlot = 0;
+    job.inOffset = 0;
+    job.outOffset = 0;
+    job.endOfInput = false;
+    job.inFd = inFd;
+    job.outFd = outFd;
+    job.error = 0;
+    err = uring_init(&job.ring, 2 * (unsigned)numSlots);
+    if (err != 0) return err;
+    
+    unpack_run(&job);
+    while (((job.error == 0) && !job.endOfInput) || (job.ring.inFlight != 0))
+    {
+        if (job.ring.inFlight == 0)
+        {
+            job.error = -EIO;       // Stalled with nothing to wait for
+            break;
+        }
+        err = uring_wait(&job.ring, unpack_complete, &job);
+        if (err != 0)
+        {
+            job.error = err;
+            break;
+        }
+    }
+    uring_exit(&job.ring);
+    return job.error;
+}
+
+#endif
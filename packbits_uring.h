@@ -0,0 +1,25 @@
+/*****************************************************************************
+packbits_uring.h  -  file to file packing and unpacking using Linux io_uring.
+******************************************************************************/
+
+#ifndef _PACKBITS_URING_H_
+#define _PACKBITS_URING_H_
+
+#ifdef __linux__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Most reads or writes of each kind kept in flight at once
+#define PACKBITS_URING_MAX_SLOTS    64
+
+// Memory needed by each slot of packbits_uring_unpack: packed input and
+// unpacked output buffers of blockSize bytes each
+#define PACKBITS_URING_UNPACK_SLOT_SIZE(n)  (2 * (n))
+
+int packbits_uring_pack(int inFd, int outFd, uint8_t *memPtr, size_t memSize, uint16_t blockSize);
+int packbits_uring_unpack(int inFd, int outFd, uint8_t *memPtr, size_t memSize, uint16_t blockSize);
+
+#endif
+
+#endif